@@ -0,0 +1,406 @@
+#ifndef AnalysisConfig_h
+#define AnalysisConfig_h
+
+// Header file for ROOT classes
+#include <TEnv.h>
+#include <TSystem.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <cerrno>
+#include <climits>
+
+// Header file for the variable definitions
+#include "Histogram.h"
+// Header file for the mixing pools
+#include "ChiEventMixer.h"
+
+
+// Selection applied to the dimuon of each candidate
+typedef struct ChiSelection {
+  double        muonPtMinBarrel;   // minimum muon pT for |eta| < 1.6
+  double        muonPtMinEndcap;   // minimum muon pT for |eta| > 1.6
+  double        muonEtaMax;
+  double        diMuonMassMin;
+  double        diMuonMassMax;
+} ChiSelection;
+
+bool operator==(const ChiSelection& a, const ChiSelection& b)
+{
+  return (a.muonPtMinBarrel==b.muonPtMinBarrel && a.muonPtMinEndcap==b.muonPtMinEndcap && a.muonEtaMax==b.muonEtaMax &&
+          a.diMuonMassMin==b.diMuonMassMin && a.diMuonMassMax==b.diMuonMassMax);
+}
+
+// Charge of the dimuons accepted in a region
+enum DiMuonSign { kAnySign = 0, kOppositeSign = 1, kSameSign = 2 };
+
+// Dimuon mass window and charge of a control region (sidebands, same-sign dimuons), filled in
+// the same pass as the nominal selection with the same muon selection
+typedef struct ChiRegion {
+  std::string   name;
+  double        diMuonMassMin;
+  double        diMuonMassMax;
+  DiMuonSign    sign;
+} ChiRegion;
+
+bool operator==(const ChiRegion& a, const ChiRegion& b)
+{
+  return (a.name==b.name && a.diMuonMassMin==b.diMuonMassMin && a.diMuonMassMax==b.diMuonMassMax && a.sign==b.sign);
+}
+
+// Regions selecting the same dimuons whatever their name, which can share one selection bit
+bool SameCut(const ChiRegion& a, const ChiRegion& b)
+{
+  return (a.diMuonMassMin==b.diMuonMassMin && a.diMuonMassMax==b.diMuonMassMax && a.sign==b.sign);
+}
+
+typedef struct AnalysisInfo {
+  std::string                               name;
+  std::vector< std::string >                samples;
+  std::vector< std::string >                beams;
+  std::map< std::string , struct VarInfo >  varInfo;
+  ChiSelection                              selection;
+  // Control regions, booked in addition to the nominal selection (dimuon mass window, any charge)
+  std::vector< ChiRegion >                  regions;
+  // Candidate weights: muon maps in (pT, eta) and conversion maps in (pT, eta), as file.root:histName
+  std::string                               muonWeightMap;
+  std::string                               convWeightMap;
+  bool                                      weightIsEfficiency;  // weight = 1/map
+  bool                                      weightInterpolate;
+  bool                                      weightAbsEta;        // maps binned in |eta|
+  // One histogram copy filled with atomic additions, for histograms too large to copy per thread
+  bool                                      sharedHistograms;
+} AnalysisInfo;
+
+
+// Analyses run in the same pass over the data, read from a TEnv file:
+//
+//   Samples:                   DATA
+//   Sample.DATA.File:          /path/to/HiChiForest.root
+//   Variables:                 ChiC_M
+//   Variable.ChiC_M.Label:     X_{C} Mass (GeV/c^{2})
+//   Variable.ChiC_M.Binning:   100 3. 4.
+//   Analyses:                  Nominal Tight
+//   Nominal.Samples:           DATA
+//   Nominal.Beams:             PA pPb Pbp
+//   Nominal.Variables:         ChiC_M ChiB_M
+//   Beam.pPb.RunRange:         285952 286504
+//   Tight.MuonPtMinBarrel:     4.0
+//   Regions:                   LowSB SameSign
+//   Region.LowSB.DiMuonMass:   2.6 2.9
+//   Region.SameSign.Sign:      SS
+//   Tight.Regions:             LowSB SameSign
+//   Tight.MuonWeightMap:       muonEff.root:hEff_pt_eta
+//   Tight.ConvWeightMap:       convEff.root:hEff_pt_eta
+//   Cache.Dir:                 /tmp/chiCache
+//   Cache.MaxSizeGB:           20
+//   EntryList.Dir:             /tmp/chiEntryLists
+//   EntryList.ChiType:         0
+//   Mixing.ZBinning:           10 -15. 15.
+//   Mixing.NPVEdges:           1 2 3 5
+//   Mixing.PoolSize:           20
+//   Mixing.Depth:              10
+//   Truth.Variables:           ChiC_M_Matched ChiC_M_Unmatched ChiC_M_Resolution ChiC_Gen_Pt ChiC_Gen_Pt_Reco
+//   ...
+//
+// Any key missing for an analysis falls back to the default analysis, and the histograms
+// of each analysis are booked as <analysis>_<sample>_<beam> (the default has no prefix).
+class AnalysisConfig {
+
+ public :
+
+  AnalysisConfig();
+  virtual ~AnalysisConfig() {};
+
+  virtual Bool_t                                   Read       (const std::string&);
+  virtual void                                     Print      (void) const;
+  std::map< std::string , std::string >&           FileName   (void) { return fileName_; }
+  std::map< std::string , struct VarInfo >&        Variables  (void) { return varInfo_;  }
+  std::vector< AnalysisInfo >&                     Analyses   (void) { return analyses_; }
+  virtual std::vector< std::string >               Samples    (void) const;
+  std::map< std::string , std::pair<UInt_t, UInt_t> >& RunRange (void) { return runRange_; }
+  const std::string&                               CacheDir   (void) const { return cacheDir_;  }
+  Long64_t                                         CacheSize  (void) const { return cacheSize_; }
+  bool                                             CacheLocal (void) const { return cacheLocal_; }
+  const std::string&                               EntryListDir  (void) const { return entryListDir_;  }
+  Int_t                                            EntryListType (void) const { return entryListType_; }
+  const MixingConfig&                              Mixing     (void) const { return mixing_; }
+
+ private:
+
+  static std::vector< std::string >                Tokenize   (const std::string&);
+  static Bool_t                                    Parse      (const std::string&, const std::string&, double&);
+  static Bool_t                                    Parse      (const std::string&, const std::string&, UInt_t&);
+  template <typename T>
+  static Bool_t                                    GetValue   (const TEnv&, const std::string&, T&);
+
+  std::map< std::string , std::string >            fileName_;
+  std::map< std::string , struct VarInfo >         varInfo_;
+  std::vector< AnalysisInfo >                      analyses_;
+  // Runs of the data taken with each beam configuration
+  std::map< std::string , std::pair<UInt_t, UInt_t> > runRange_;
+  // Local disk cache of the remote (root://) inputs, disabled if no directory is given
+  std::string                                      cacheDir_;
+  Long64_t                                         cacheSize_;
+  bool                                             cacheLocal_;   // also cache the local inputs, to test the cache
+  // Lists of the entries with chi candidates (of one type, 0: any), disabled if no directory is given
+  std::string                                      entryListDir_;
+  Int_t                                            entryListType_;
+  // Event classes and pool sizes of the event mixing
+  MixingConfig                                     mixing_;
+};
+
+AnalysisConfig::AnalysisConfig() : cacheSize_(0), cacheLocal_(false), entryListType_(0)
+{
+  // Default analysis, used when no configuration file is given
+  fileName_ = {
+    {"DATA"             , "/home/llr/cms/stahl/HIConversions/Test/CMSSW_8_0_26_patch2/src/crab_PARun2016C-v1_Run_DoubleMuon_285479_286504_CHIC_pA_20170503/results/HiChiForest.root"}
+  };
+  varInfo_ = {
+    { "ChiC_M"   , { "X_{C} Mass (GeV/c^{2})" , 100 , 3., 4. } },
+    { "ChiB_M"   , { "X_{B} Mass (GeV/c^{2})" , 100 , 9., 12. } },
+    { "ChiC_M_Rebuilt" , { "X_{C} Mass (GeV/c^{2})" , 100 , 3., 4. } },
+    { "ChiB_M_Rebuilt" , { "X_{B} Mass (GeV/c^{2})" , 100 , 9., 12. } }
+  };
+  AnalysisInfo analysis;
+  analysis.name      = "";
+  analysis.samples   = { "DATA" };
+  analysis.beams     = { "PA" };
+  analysis.varInfo   = varInfo_;
+  analysis.selection = { 3.0 , 3.0 , 1.E9 , 0. , 1.E9 };
+  analysis.muonWeightMap = "";
+  analysis.convWeightMap = "";
+  analysis.weightIsEfficiency = true;
+  analysis.weightInterpolate  = false;
+  analysis.weightAbsEta       = false;
+  analysis.sharedHistograms   = false;
+  analyses_ = { analysis };
+  // Combinatorial background from the event mixing, only booked by the analyses listing them
+  varInfo_["ChiC_M_Mixed"]      = { "Mixed X_{C} Mass (GeV/c^{2})" , 100 , 3. , 4. };
+  varInfo_["ChiB_M_Mixed"]      = { "Mixed X_{B} Mass (GeV/c^{2})" , 100 , 9. , 12. };
+  // Truth matching of the MC samples, only booked by the analyses listing them
+  varInfo_["ChiC_M_Matched"]    = { "Matched X_{C} Mass (GeV/c^{2})" , 100 , 3. , 4. };
+  varInfo_["ChiC_M_Unmatched"]  = { "Unmatched X_{C} Mass (GeV/c^{2})" , 100 , 3. , 4. };
+  varInfo_["ChiC_M_Resolution"] = { "X_{C} Mass - True Mass (GeV/c^{2})" , 100 , -0.1 , 0.1 };
+  varInfo_["ChiC_Gen_Pt"]       = { "True X_{C} p_{T} (GeV/c)" , 30 , 0. , 30. };
+  varInfo_["ChiC_Gen_Pt_Reco"]  = { "Reconstructed True X_{C} p_{T} (GeV/c)" , 30 , 0. , 30. };
+  mixing_ = { 10 , -15. , 15. , { 1 , 2 , 3 , 5 } , 20 , 10 , 16 };
+  runRange_ = {
+    { "pPb" , { 285952 , 286504 } },
+    { "Pbp" , { 285410 , 285951 } }
+  };
+}
+
+Bool_t AnalysisConfig::Read(const std::string& configFile)
+{
+  if (gSystem->AccessPathName(configFile.c_str())) { std::cout << "[ERROR] Configuration file " << configFile << " not found!" << std::endl; return false; }
+  TEnv env;
+  if (env.ReadFile(configFile.c_str(), kEnvUser)!=0) { std::cout << "[ERROR] Failed to read the configuration file " << configFile << std::endl; return false; }
+  const AnalysisInfo def = analyses_[0];
+
+  // Input files, the default ones are kept if no sample is given
+  const std::vector< std::string > samples = Tokenize(env.GetValue("Samples", ""));
+  if (samples.size()>0) fileName_.clear();
+  for (auto& sample : samples) {
+    const std::string file = env.GetValue(("Sample."+sample+".File").c_str(), "");
+    if (file=="") { std::cout << "[ERROR] No input file for sample " << sample << std::endl; return false; }
+    fileName_[sample] = file;
+  }
+  // Variable definitions, added to the default ones
+  for (auto& var : Tokenize(env.GetValue("Variables", ""))) {
+    const std::vector< std::string > binning = Tokenize(env.GetValue(("Variable."+var+".Binning").c_str(), ""));
+    if (binning.size()!=3) { std::cout << "[ERROR] Variable." << var << ".Binning must be: nBin min max" << std::endl; return false; }
+    const std::string key = "Variable."+var+".Binning";
+    UInt_t nBin; double min, max;
+    if (!Parse(key, binning[0], nBin) || !Parse(key, binning[1], min) || !Parse(key, binning[2], max)) return false;
+    varInfo_[var] = { env.GetValue(("Variable."+var+".Label").c_str(), var.c_str()) , nBin , float(min) , float(max) };
+  }
+  // Local cache of the remote inputs
+  cacheDir_  = env.GetValue("Cache.Dir", "");
+  double cacheSizeGB = 10.;
+  if (!GetValue(env, "Cache.MaxSizeGB", cacheSizeGB)) return false;
+  if (cacheSizeGB < 0.) { std::cout << "[ERROR] Cache.MaxSizeGB can not be negative!" << std::endl; return false; }
+  cacheSize_ = Long64_t(cacheSizeGB*1073741824.);
+  cacheLocal_ = env.GetValue("Cache.Local", 0);
+  // Entries with chi candidates, only these entries are read from the forest
+  entryListDir_  = env.GetValue("EntryList.Dir", "");
+  UInt_t chiType = 0;
+  if (!GetValue(env, "EntryList.ChiType", chiType) || chiType > INT_MAX) { std::cout << "[ERROR] Invalid EntryList.ChiType!" << std::endl; return false; }
+  entryListType_ = Int_t(chiType);
+  // Event mixing, the pools are only filled if a mixed variable is booked
+  const std::vector< std::string > zBinning = Tokenize(env.GetValue("Mixing.ZBinning", ""));
+  if (zBinning.size()>0) {
+    if (zBinning.size()!=3) { std::cout << "[ERROR] Mixing.ZBinning must be: nBin min max" << std::endl; return false; }
+    if (!Parse("Mixing.ZBinning", zBinning[0], mixing_.nZBin) || !Parse("Mixing.ZBinning", zBinning[1], mixing_.zMin) ||
+        !Parse("Mixing.ZBinning", zBinning[2], mixing_.zMax)) return false;
+    if (mixing_.nZBin==0 || mixing_.zMax <= mixing_.zMin) { std::cout << "[ERROR] Invalid Mixing.ZBinning!" << std::endl; return false; }
+  }
+  const std::vector< std::string > nPVEdges = Tokenize(env.GetValue("Mixing.NPVEdges", ""));
+  if (nPVEdges.size()>0) {
+    mixing_.nPVEdges.clear();
+    for (auto& edge : nPVEdges) {
+      UInt_t value;
+      if (!Parse("Mixing.NPVEdges", edge, value)) return false;
+      mixing_.nPVEdges.push_back(value);
+    }
+    if (!std::is_sorted(mixing_.nPVEdges.begin(), mixing_.nPVEdges.end())) { std::cout << "[ERROR] Mixing.NPVEdges must be increasing!" << std::endl; return false; }
+  }
+  if (!GetValue(env, "Mixing.PoolSize", mixing_.capacity) || !GetValue(env, "Mixing.Depth", mixing_.depth) ||
+      !GetValue(env, "Mixing.MaxConversions", mixing_.maxConv)) return false;
+  if (mixing_.capacity==0 || mixing_.depth==0 || mixing_.maxConv==0) { std::cout << "[ERROR] Mixing.PoolSize, Mixing.Depth and Mixing.MaxConversions must be positive!" << std::endl; return false; }
+  // Control regions: the dimuon mass window (default: the one of the analysis) and charge (OS, SS or any)
+  std::map< std::string , std::pair< std::vector< double > , std::string > > regionDef;
+  for (auto& region : Tokenize(env.GetValue("Regions", ""))) {
+    const std::vector< std::string > massWindow = Tokenize(env.GetValue(("Region."+region+".DiMuonMass").c_str(), ""));
+    const std::string sign = env.GetValue(("Region."+region+".Sign").c_str(), "any");
+    if (massWindow.size()!=0 && massWindow.size()!=2) { std::cout << "[ERROR] Region." << region << ".DiMuonMass must be: min max" << std::endl; return false; }
+    if (sign!="any" && sign!="OS" && sign!="SS") { std::cout << "[ERROR] Region." << region << ".Sign must be OS, SS or any" << std::endl; return false; }
+    std::vector< double > mass(massWindow.size());
+    for (size_t i = 0; i < massWindow.size(); i++) { if (!Parse("Region."+region+".DiMuonMass", massWindow[i], mass[i])) return false; }
+    regionDef[region] = std::make_pair(mass, sign);
+  }
+  // Analyses
+  analyses_.clear();
+  for (auto& name : Tokenize(env.GetValue("Analyses", ""))) {
+    const std::string p = name + ".";
+    AnalysisInfo analysis = def;
+    analysis.name = name;
+    const std::string samples = env.GetValue((p+"Samples").c_str(), "");
+    const std::string beams   = env.GetValue((p+"Beams"  ).c_str(), "");
+    if (samples!="") analysis.samples = Tokenize(samples);
+    if (beams  !="") analysis.beams   = Tokenize(beams);
+    const std::string vars = env.GetValue((p+"Variables").c_str(), "");
+    if (vars!="") {
+      analysis.varInfo.clear();
+      for (auto& var : Tokenize(vars)) {
+        if (varInfo_.count(var)==0) { std::cout << "[ERROR] Variable " << var << " of analysis " << name << " is not defined!" << std::endl; return false; }
+        analysis.varInfo[var] = varInfo_.at(var);
+      }
+    }
+    ChiSelection& sel = analysis.selection;
+    if (!GetValue(env, p+"MuonPtMinBarrel", sel.muonPtMinBarrel) || !GetValue(env, p+"MuonPtMinEndcap", sel.muonPtMinEndcap) ||
+        !GetValue(env, p+"MuonEtaMax"     , sel.muonEtaMax     ) || !GetValue(env, p+"DiMuonMassMin"  , sel.diMuonMassMin  ) ||
+        !GetValue(env, p+"DiMuonMassMax"  , sel.diMuonMassMax  )) return false;
+    analysis.muonWeightMap      = env.GetValue((p+"MuonWeightMap"     ).c_str(), analysis.muonWeightMap.c_str());
+    analysis.convWeightMap      = env.GetValue((p+"ConvWeightMap"     ).c_str(), analysis.convWeightMap.c_str());
+    analysis.weightIsEfficiency = env.GetValue((p+"WeightIsEfficiency").c_str(), Int_t(analysis.weightIsEfficiency));
+    analysis.weightInterpolate  = env.GetValue((p+"WeightInterpolate" ).c_str(), Int_t(analysis.weightInterpolate));
+    analysis.weightAbsEta       = env.GetValue((p+"WeightAbsEta"      ).c_str(), Int_t(analysis.weightAbsEta));
+    analysis.sharedHistograms   = env.GetValue((p+"SharedHistograms"  ).c_str(), Int_t(analysis.sharedHistograms));
+    analysis.regions.clear();
+    for (auto& region : Tokenize(env.GetValue((p+"Regions").c_str(), ""))) {
+      if (regionDef.count(region)==0) { std::cout << "[ERROR] Region " << region << " of analysis " << name << " is not defined!" << std::endl; return false; }
+      const std::vector< double >& mass = regionDef.at(region).first;
+      const std::string& sign = regionDef.at(region).second;
+      analysis.regions.push_back({ region ,
+            (mass.size()==2 ? mass[0] : sel.diMuonMassMin) , (mass.size()==2 ? mass[1] : sel.diMuonMassMax) ,
+            (sign=="OS" ? kOppositeSign : (sign=="SS" ? kSameSign : kAnySign)) });
+    }
+    analyses_.push_back(analysis);
+  }
+  if (analyses_.size()==0) { std::cout << "[ERROR] No analysis defined in " << configFile << std::endl; return false; }
+  // Run ranges of the beam configurations, e.g. Beam.pPb.RunRange: 285952 286504
+  for (auto& analysis : analyses_) {
+    for (auto& beam : analysis.beams) {
+      const std::vector< std::string > range = Tokenize(env.GetValue(("Beam."+beam+".RunRange").c_str(), ""));
+      if (range.size()==0) continue;
+      if (range.size()!=2) { std::cout << "[ERROR] Beam." << beam << ".RunRange must be: runMin runMax" << std::endl; return false; }
+      const std::string key = "Beam."+beam+".RunRange";
+      UInt_t runMin, runMax;
+      if (!Parse(key, range[0], runMin) || !Parse(key, range[1], runMax)) return false;
+      runRange_[beam] = std::make_pair(runMin, runMax);
+    }
+  }
+  Print();
+  return true;
+}
+
+std::vector< std::string > AnalysisConfig::Samples(void) const
+{
+  // Sample labels read in the pass, each sample is only read once for all the analyses
+  std::vector< std::string > samples;
+  for (auto & analysis : analyses_) {
+    for (auto & sample : analysis.samples) {
+      std::vector< std::string > names;
+      if (sample=="DATA" && (fileName_.count(sample)>0)) { names.push_back(sample); }
+      else {
+        for (auto & beam : analysis.beams) {
+          std::string name = sample + "_" + beam;
+          if ((fileName_.count(name)>0)) { names.push_back(name); }
+        }
+      }
+      for (auto & name : names) { if (std::find(samples.begin(), samples.end(), name)==samples.end()) samples.push_back(name); }
+    }
+  }
+  return samples;
+}
+
+void AnalysisConfig::Print(void) const
+{
+  for (auto& analysis : analyses_) {
+    std::cout << "[INFO] Analysis " << (analysis.name=="" ? "default" : analysis.name) << " :";
+    for (auto& s : analysis.samples) { std::cout << " " << s; }
+    std::cout << " |";
+    for (auto& b : analysis.beams) { std::cout << " " << b; }
+    std::cout << " | " << analysis.varInfo.size() << " variables | muon pT > " << analysis.selection.muonPtMinBarrel << " (barrel) "
+              << analysis.selection.muonPtMinEndcap << " (endcap) , |eta| < " << analysis.selection.muonEtaMax
+              << " , " << analysis.selection.diMuonMassMin << " < m(mumu) < " << analysis.selection.diMuonMassMax;
+    if (analysis.muonWeightMap!="") std::cout << " , muon weights " << analysis.muonWeightMap;
+    if (analysis.convWeightMap!="") std::cout << " , conversion weights " << analysis.convWeightMap;
+    for (auto& region : analysis.regions) {
+      std::cout << " , region " << region.name << " (" << region.diMuonMassMin << " < m(mumu) < " << region.diMuonMassMax
+                << (region.sign==kOppositeSign ? ", OS" : (region.sign==kSameSign ? ", SS" : "")) << ")";
+    }
+    std::cout << std::endl;
+  }
+}
+
+std::vector< std::string > AnalysisConfig::Tokenize(const std::string& s)
+{
+  std::vector< std::string > tokens;
+  std::stringstream ss(s);
+  std::string item;
+  while (ss >> item) { tokens.push_back(item); }
+  return tokens;
+}
+
+Bool_t AnalysisConfig::Parse(const std::string& key, const std::string& value, double& x)
+{
+  // The whole value must be a finite number
+  char* end = 0;
+  errno = 0;
+  const double v = std::strtod(value.c_str(), &end);
+  if (value=="" || *end!='\0' || errno==ERANGE || !std::isfinite(v)) { std::cout << "[ERROR] Invalid value " << value << " of " << key << std::endl; return false; }
+  x = v;
+  return true;
+}
+
+Bool_t AnalysisConfig::Parse(const std::string& key, const std::string& value, UInt_t& x)
+{
+  // strtoul accepts a sign, which is not a valid count or run number
+  char* end = 0;
+  errno = 0;
+  const unsigned long v = std::strtoul(value.c_str(), &end, 10);
+  if (value=="" || value.find('-')!=std::string::npos || *end!='\0' || errno==ERANGE || v > UINT_MAX) {
+    std::cout << "[ERROR] Invalid value " << value << " of " << key << std::endl; return false;
+  }
+  x = UInt_t(v);
+  return true;
+}
+
+template <typename T>
+Bool_t AnalysisConfig::GetValue(const TEnv& env, const std::string& key, T& x)
+{
+  // A missing key keeps the current value, a given one must be a valid number
+  const std::string value = env.GetValue(key.c_str(), "");
+  return (value=="" || Parse(key, value, x));
+}
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef BlockCache_h
+#define BlockCache_h
+
+// Header file for c++ classes
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+
+// Raw access to the bytes of an input file, e.g. a remote file opened with ?filetype=raw.
+// Read follows the ROOT convention and returns true on error.
+class BlockSource {
+
+ public :
+
+  virtual ~BlockSource() {};
+
+  virtual int64_t      GetSize   (void) = 0;
+  virtual bool         Read      (char* buf, const int64_t pos, const int len) = 0;
+  // Vectored read of n pieces packed one after the other in buf
+  virtual bool         ReadV     (char* buf, const int64_t* pos, const int* len, const int n)
+  {
+    for (int i = 0; i < n; i++) { if (Read(buf, pos[i], len[i])) return true; buf += len[i]; }
+    return false;
+  }
+};
+
+
+// Blocks of the input files kept on the local disk, keyed by the file URL and size and by the
+// block offset. Each block file starts with a header holding its index, length and checksum,
+// and blocks failing the check are fetched again. The total size is bounded by evicting the
+// least recently used blocks, the use order is kept in the modification time of the block
+// files so that it survives between jobs. Several jobs can share the same directory: blocks
+// are written to a temporary file and renamed, and each job scans the directory again every
+// time it has written 1/kScanFraction of the maximum size, so that the blocks of the other
+// jobs count in the total. The limit is thus shared, up to what the other jobs wrote since
+// the last scan. A BlockCache can be used from several threads.
+class BlockCache {
+
+ public :
+
+  BlockCache(const std::string& dir, const int64_t maxBytes, const int blockSize=(1<<20));
+  virtual ~BlockCache() {};
+
+  // Key of a file, also the name of its directory in the cache
+  static std::string   Key         (const std::string& url, const int64_t size);
+  static uint64_t      Checksum    (const char* data, const size_t n);
+
+  // Fill the blocks with the given indices, fetching the missing ones with one vectored read
+  virtual bool         Get         (BlockSource&, const std::string& key, const std::vector<int64_t>& index, std::vector< std::vector<char> >& block);
+  int                  BlockSize   (void) const { return blockSize_; }
+  int64_t              GetNBytes   (void) const { return nBytes_; }
+  void                 Print       (void) const;
+
+ private:
+
+  typedef struct BlockHeader {
+    uint32_t   magic;
+    uint32_t   length;
+    int64_t    index;
+    uint64_t   checksum;
+  } BlockHeader;
+
+  static const uint32_t kMagic = 0x43484942;  // "CHIB"
+  static const int      kScanFraction = 32;
+
+  virtual void         Scan        (void);
+  virtual bool         Load        (const std::string& path, const int64_t index, std::vector<char>& data);
+  virtual bool         Store       (const std::string& path, const int64_t index, const std::vector<char>& data);
+  virtual void         Touch       (const std::string& path, const int64_t size, const bool isNew);
+  virtual void         Evict       (void);
+  std::string          Path        (const std::string& key, const int64_t index) const { return dir_ + "/" + key + "/" + std::to_string(index) + ".blk"; }
+
+  std::string                                                 dir_;
+  int64_t                                                     maxBytes_;
+  int                                                         blockSize_;
+  int64_t                                                     nBytes_;
+  int64_t                                                     nBytesSinceScan_;   // written by this job
+  // Least recently used blocks first, with their size on disk
+  std::list< std::pair<std::string, int64_t> >                lru_;
+  std::unordered_map< std::string , std::list< std::pair<std::string, int64_t> >::iterator > where_;
+  std::mutex                                                  mutex_;
+  int64_t                                                     nHit_;
+  int64_t                                                     nMiss_;
+  int64_t                                                     nBad_;
+};
+
+BlockCache::BlockCache(const std::string& dir, const int64_t maxBytes, const int blockSize) :
+  dir_(dir), maxBytes_(maxBytes), blockSize_(blockSize), nBytes_(0), nBytesSinceScan_(0), nHit_(0), nMiss_(0), nBad_(0)
+{
+  mkdir(dir_.c_str(), 0755);
+  Scan();
+  Evict();
+}
+
+std::string BlockCache::Key(const std::string& url, const int64_t size)
+{
+  // A file that changes size gets a new key, its old blocks are evicted in time
+  std::stringstream ss;
+  ss << std::hex << std::setfill('0') << std::setw(16) << Checksum(url.data(), url.size()) << "_" << size;
+  return ss.str();
+}
+
+uint64_t BlockCache::Checksum(const char* data, const size_t n)
+{
+  // 64-bit multiply-xorshift hash, reading 8 bytes at a time; it detects truncated or
+  // corrupted blocks, it is not meant to resist tampering
+  uint64_t h = 0x9E3779B97F4A7C15ULL ^ n;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t v;
+    std::memcpy(&v, data + i, 8);
+    v *= 0xBF58476D1CE4E5B9ULL; v ^= (v >> 31);
+    h = (h ^ v)*0x94D049BB133111EBULL;
+    h ^= (h >> 29);
+  }
+  uint64_t v = 0;
+  std::memcpy(&v, data + i, n - i);
+  h = (h ^ (v*0xBF58476D1CE4E5B9ULL))*0x94D049BB133111EBULL;
+  return h ^ (h >> 32);
+}
+
+void BlockCache::Scan(void)
+{
+  // Rebuild the use order of the blocks on disk, of all the jobs, from their modification time.
+  // Blocks used within the resolution of the file times keep the order known by this job, after
+  // those of the other jobs
+  std::unordered_map< std::string , int64_t > rank;
+  int64_t n = 0;
+  for (auto& block : lru_) { rank[block.first] = ++n; }
+  std::vector< std::pair< std::pair<int64_t, int64_t> , std::pair<std::string, int64_t> > > blocks;
+  DIR* top = opendir(dir_.c_str());
+  if (!top) { std::cout << "[ERROR] Failed to open the cache directory " << dir_ << std::endl; return; }
+  while (struct dirent* key = readdir(top)) {
+    if (key->d_name[0]=='.') continue;
+    const std::string keyDir = dir_ + "/" + key->d_name;
+    DIR* sub = opendir(keyDir.c_str());
+    if (!sub) continue;
+    while (struct dirent* block = readdir(sub)) {
+      const std::string name = block->d_name;
+      if (name.size() < 5 || name.substr(name.size()-4)!=".blk") continue;
+      struct stat st;
+      const std::string path = keyDir + "/" + name;
+      if (stat(path.c_str(), &st)!=0) continue;
+      const int64_t time = int64_t(st.st_mtim.tv_sec)*1000000000LL + st.st_mtim.tv_nsec;
+      auto it = rank.find(path);
+      blocks.push_back(std::make_pair(std::make_pair(time, (it!=rank.end() ? it->second : 0)), std::make_pair(path, int64_t(st.st_size))));
+    }
+    closedir(sub);
+  }
+  closedir(top);
+  std::sort(blocks.begin(), blocks.end());
+  lru_.clear();
+  where_.clear();
+  nBytes_ = 0;
+  nBytesSinceScan_ = 0;
+  for (auto& block : blocks) {
+    lru_.push_back(block.second);
+    where_[block.second.first] = std::prev(lru_.end());
+    nBytes_ += block.second.second;
+  }
+}
+
+bool BlockCache::Get(BlockSource& source, const std::string& key, const std::vector<int64_t>& index, std::vector< std::vector<char> >& block)
+{
+  const int64_t size = source.GetSize();
+  block.resize(index.size());
+  std::vector<size_t> missing;
+  for (size_t i = 0; i < index.size(); i++) {
+    if (Load(Path(key, index[i]), index[i], block[i])) { Touch(Path(key, index[i]), 0, false); continue; }
+    missing.push_back(i);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nHit_  += index.size() - missing.size();
+    nMiss_ += missing.size();
+  }
+  if (missing.empty()) return false;
+  // Fetch all the missing blocks at once
+  std::vector<int64_t> pos(missing.size());
+  std::vector<int> len(missing.size());
+  int64_t total = 0;
+  for (size_t i = 0; i < missing.size(); i++) {
+    pos[i] = index[missing[i]]*int64_t(blockSize_);
+    len[i] = int(std::min(int64_t(blockSize_), size - pos[i]));
+    if (len[i] <= 0) { std::cout << "[ERROR] Block " << index[missing[i]] << " is beyond the end of the file!" << std::endl; return true; }
+    total += len[i];
+  }
+  std::vector<char> buf(total);
+  if (source.ReadV(buf.data(), pos.data(), len.data(), int(missing.size()))) return true;
+  mkdir((dir_ + "/" + key).c_str(), 0755);
+  const char* p = buf.data();
+  for (size_t i = 0; i < missing.size(); i++) {
+    std::vector<char>& data = block[missing[i]];
+    data.assign(p, p + len[i]);
+    p += len[i];
+    const std::string path = Path(key, index[missing[i]]);
+    if (Store(path, index[missing[i]], data)) Touch(path, int64_t(sizeof(BlockHeader)) + len[i], true);
+  }
+  Evict();
+  return false;
+}
+
+bool BlockCache::Load(const std::string& path, const int64_t index, std::vector<char>& data)
+{
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file) return false;
+  BlockHeader header;
+  bool good = bool(file.read(reinterpret_cast<char*>(&header), sizeof(header)));
+  good = (good && header.magic==kMagic && header.index==index && header.length <= uint32_t(blockSize_));
+  if (good) {
+    data.resize(header.length);
+    good = (file.read(data.data(), header.length) && file.gcount()==std::streamsize(header.length) &&
+            Checksum(data.data(), data.size())==header.checksum);
+  }
+  if (!good) {
+    // Corrupted or truncated (e.g. a job killed while writing), fetched again
+    std::cout << "[INFO] Dropping the bad cache block " << path << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+    nBad_++;
+    std::remove(path.c_str());
+    auto it = where_.find(path);
+    if (it!=where_.end()) { nBytes_ -= it->second->second; lru_.erase(it->second); where_.erase(it); }
+  }
+  return good;
+}
+
+bool BlockCache::Store(const std::string& path, const int64_t index, const std::vector<char>& data)
+{
+  // Written to a temporary file first, so that other jobs never read a partial block
+  std::stringstream tmp;
+  tmp << path << ".tmp." << getpid() << "." << std::this_thread::get_id();
+  const BlockHeader header = { kMagic , uint32_t(data.size()) , index , Checksum(data.data(), data.size()) };
+  {
+    std::ofstream file(tmp.str().c_str(), std::ios::binary | std::ios::trunc);
+    if (!file) { std::cout << "[ERROR] Failed to write the cache block " << tmp.str() << std::endl; return false; }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(data.data(), data.size());
+    if (!file) { std::remove(tmp.str().c_str()); return false; }
+  }
+  if (std::rename(tmp.str().c_str(), path.c_str())!=0) { std::remove(tmp.str().c_str()); return false; }
+  return true;
+}
+
+void BlockCache::Touch(const std::string& path, const int64_t size, const bool isNew)
+{
+  if (!isNew) utime(path.c_str(), 0);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = where_.find(path);
+  if (it!=where_.end()) {
+    // Move to the most recently used end
+    lru_.splice(lru_.end(), lru_, it->second);
+    if (isNew) { nBytes_ += size - it->second->second; nBytesSinceScan_ += size; it->second->second = size; }
+    return;
+  }
+  // Blocks written by another job are only accounted once this job uses them
+  int64_t n = size;
+  if (!isNew) { struct stat st; n = (stat(path.c_str(), &st)==0 ? int64_t(st.st_size) : 0); }
+  lru_.push_back(std::make_pair(path, n));
+  where_[path] = std::prev(lru_.end());
+  nBytes_ += n;
+  if (isNew) nBytesSinceScan_ += n;
+}
+
+void BlockCache::Evict(void)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Count the blocks written by the other jobs sharing the directory
+  if (nBytesSinceScan_ >= maxBytes_/kScanFraction) Scan();
+  while (nBytes_ > maxBytes_ && !lru_.empty()) {
+    std::remove(lru_.front().first.c_str());
+    nBytes_ -= lru_.front().second;
+    where_.erase(lru_.front().first);
+    lru_.pop_front();
+  }
+}
+
+void BlockCache::Print(void) const
+{
+  std::cout << "[INFO] Block cache " << dir_ << " : " << nHit_ << " hits, " << nMiss_ << " misses, " << nBad_ << " bad blocks, "
+            << nBytes_/1048576. << " / " << maxBytes_/1048576. << " MB used" << std::endl;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef BulkBranch_h
+#define BulkBranch_h
+
+// Header file for ROOT classes
+#include <TTree.h>
+#include <TBranch.h>
+#include <TLeaf.h>
+#include <TBufferFile.h>
+#include <Bytes.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+// Values of a branch holding one integer per entry (e.g. Event_Run), read for a range of
+// consecutive entries at once. Each basket is deserialized in one go with the bulk API, without
+// the branch address and the per-entry bookkeeping of GetEntry, and kept while the ranges are
+// inside it. Branches that can not be read in bulk fall back to reading the leaf of each entry.
+template <typename T>
+class BulkBranch {
+
+ public :
+
+  BulkBranch() : branch_(0), leaf_(0), first_(0), buffer_(TBuffer::kWrite, 32*1024), bulk_(true) {};
+  virtual ~BulkBranch() {};
+
+  virtual Bool_t       Init      (TTree*, const std::string&);
+  virtual Bool_t       Get       (const Long64_t first, const Long64_t n, T* values);
+
+ private:
+
+  BulkBranch(const BulkBranch&);
+  BulkBranch& operator=(const BulkBranch&);
+
+  virtual Bool_t       Load      (const Long64_t);
+
+  TBranch*             branch_;
+  TLeaf*               leaf_;
+  Long64_t             first_;    // entry of values_[0]
+  std::vector<T>       values_;   // values of the last basket read
+  TBufferFile          buffer_;
+  bool                 bulk_;
+};
+
+template <typename T>
+Bool_t BulkBranch<T>::Init(TTree* tree, const std::string& name)
+{
+  leaf_   = (tree ? tree->GetLeaf(name.c_str()) : 0);
+  branch_ = (leaf_ ? leaf_->GetBranch() : 0);
+  first_  = 0;
+  values_.clear();
+  bulk_   = true;
+  if (!branch_) { std::cout << "[ERROR] Branch " << name << " not found!" << std::endl; return false; }
+  return true;
+}
+
+template <typename T>
+Bool_t BulkBranch<T>::Get(const Long64_t first, const Long64_t n, T* values)
+{
+  if (!branch_) return false;
+  for (Long64_t entry = first; entry < first + n; ) {
+    if (entry < first_ || entry >= first_ + Long64_t(values_.size())) {
+      if (!Load(entry)) return false;
+    }
+    // Copy what the basket holds of the range
+    const Long64_t end = std::min(first + n, first_ + Long64_t(values_.size()));
+    std::copy(values_.begin() + (entry - first_), values_.begin() + (end - first_), values + (entry - first));
+    entry = end;
+  }
+  return true;
+}
+
+template <typename T>
+Bool_t BulkBranch<T>::Load(const Long64_t entry)
+{
+  values_.clear();
+  if (bulk_) {
+    // The bulk read returns all the entries of a basket, asked from its first entry
+    const Long64_t* basketEntry = branch_->GetBasketEntry();
+    const Int_t nBasket = branch_->GetWriteBasket();
+    const Long64_t* it = std::upper_bound(basketEntry, basketEntry + nBasket + 1, entry);
+    first_ = (it==basketEntry ? 0 : *(it - 1));
+    const Int_t count = branch_->GetBulkRead().GetEntriesSerialized(first_, buffer_);
+    if (count > 0 && entry < first_ + count) {
+      // Serialized in big-endian order
+      values_.resize(count);
+      char* p = buffer_.GetCurrent();
+      for (Int_t i = 0; i < count; i++) { frombuf(p, &values_[i]); }
+      return true;
+    }
+    std::cout << "[INFO] Branch " << branch_->GetName() << " can not be read in bulk, reading it entry by entry" << std::endl;
+    bulk_ = false;
+  }
+  first_ = entry;
+  if (branch_->GetEntry(entry, 1) <= 0) { std::cout << "[ERROR] Failed to read " << branch_->GetName() << " at entry " << entry << std::endl; return false; }
+  values_.push_back(T(leaf_->GetValueLong64()));
+  return true;
+}
+
+#endif
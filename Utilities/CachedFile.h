@@ -0,0 +1,224 @@
+#ifndef CachedFile_h
+#define CachedFile_h
+
+// Header file for ROOT classes
+#include <TFile.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+// Header file for the disk cache
+#include "BlockCache.h"
+
+
+// Raw bytes of a file read through ROOT, e.g. root://server//path/file.root
+class RootBlockSource : public BlockSource {
+
+ public :
+
+  RootBlockSource(const std::string& url) : file_(TFile::Open((url + (url.find('?')==std::string::npos ? "?" : "&") + "filetype=raw").c_str())) {};
+  virtual ~RootBlockSource() {};
+
+  bool                 IsOpen    (void) const { return (file_ && file_->IsOpen()); }
+  virtual int64_t      GetSize   (void) { return file_->GetSize(); }
+  virtual bool         Read      (char* buf, const int64_t pos, const int len) { return file_->ReadBuffer(buf, pos, len); }
+  virtual bool         ReadV     (char* buf, const int64_t* pos, const int* len, const int n)
+  {
+    std::vector<Long64_t> p(pos, pos + n);
+    std::vector<Int_t> l(len, len + n);
+    return file_->ReadBuffers(buf, p.data(), l.data(), n);
+  }
+
+ private:
+
+  std::unique_ptr<TFile> file_;
+};
+
+
+// Read-only TFile whose bytes come from a local BlockCache, the remote file is only read for
+// the blocks missing in the cache. The last blocks used are also kept in memory, since the
+// keys, the tree headers and the baskets of one cluster are read in many small pieces.
+// The cache is set once per job with SetCache, and OpenFile is then used instead of
+// TFile::Open for the inputs: remote files go through the cache, local ones are opened as
+// usual (unless cacheLocal is set, which allows to test the cache with local files).
+class TCachedFile : public TFile {
+
+ public :
+
+  TCachedFile(const std::string& url, BlockCache& cache, const UInt_t nMemBlocks=32);
+  virtual ~TCachedFile() {};
+
+  static void          SetCache    (const std::string& dir, const Long64_t maxBytes, const Int_t blockSize=(1<<20), const bool cacheLocal=false);
+  static TFile*        OpenFile    (const std::string&);
+  static BlockCache*   Cache       (void) { return cache_.get(); }
+
+  virtual Bool_t       IsOpen      (void) const { return (fD==-2 && !IsZombie()); }
+  virtual Long64_t     GetSize     (void) const { return size_; }
+  virtual void         Seek        (Long64_t, ERelativeTo=kBeg);
+  virtual Bool_t       ReadBuffer  (char*, Int_t);
+  virtual Bool_t       ReadBuffer  (char*, Long64_t, Int_t);
+  virtual Bool_t       ReadBuffers (char*, Long64_t*, Int_t*, Int_t);
+
+ private:
+
+  virtual Bool_t       Fetch       (const std::vector<Long64_t>&);
+  virtual const char*  Block       (const Long64_t);
+  virtual Bool_t       Copy        (char*, Long64_t, Int_t);
+
+  RootBlockSource                                        source_;
+  BlockCache&                                            blockCache_;
+  std::string                                            key_;
+  Long64_t                                               size_;
+  Int_t                                                  blockSize_;
+  UInt_t                                                 nMemBlocks_;
+  // Blocks kept in memory, most recently used first
+  std::list< std::pair< Long64_t , std::vector<char> > > memory_;
+
+  static std::unique_ptr<BlockCache>                     cache_;
+  static bool                                            cacheLocal_;
+  static std::mutex                                      mutex_;
+};
+
+std::unique_ptr<BlockCache> TCachedFile::cache_;
+bool TCachedFile::cacheLocal_ = false;
+std::mutex TCachedFile::mutex_;
+
+TCachedFile::TCachedFile(const std::string& url, BlockCache& cache, const UInt_t nMemBlocks) :
+  TFile(url.c_str(), "WEB"), source_(url), blockCache_(cache), size_(-1), blockSize_(cache.BlockSize()), nMemBlocks_(std::max(nMemBlocks, 1U))
+{
+  // As for the other network files, the TFile constructor does not open anything with "WEB"
+  if (!source_.IsOpen()) { std::cout << "[ERROR] Failed to open " << url << std::endl; MakeZombie(); return; }
+  size_ = source_.GetSize();
+  key_  = BlockCache::Key(url, size_);
+  fD = -2;
+  fEND = size_;
+  Init(kFALSE);
+}
+
+void TCachedFile::SetCache(const std::string& dir, const Long64_t maxBytes, const Int_t blockSize, const bool cacheLocal)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.reset(dir!="" ? new BlockCache(dir, maxBytes, blockSize) : 0);
+  cacheLocal_ = cacheLocal;
+  if (cache_) std::cout << "[INFO] Caching the remote inputs in " << dir << " (" << maxBytes/1073741824. << " GB)" << std::endl;
+}
+
+TFile* TCachedFile::OpenFile(const std::string& fileName)
+{
+  const bool remote = (fileName.find("://")!=std::string::npos && fileName.find("file://")!=0);
+  if (!cache_ || (!remote && !cacheLocal_)) return TFile::Open(fileName.c_str());
+  TCachedFile* file = new TCachedFile(fileName, *cache_);
+  if (file->IsZombie()) { delete file; return 0; }
+  return file;
+}
+
+void TCachedFile::Seek(Long64_t offset, ERelativeTo pos)
+{
+  // No file descriptor to move, only the offset used by ReadBuffer(char*, Int_t)
+  switch (pos) {
+  case kBeg : fOffset = offset; break;
+  case kCur : fOffset += offset; break;
+  case kEnd : fOffset = size_ - offset; break;
+  }
+}
+
+Bool_t TCachedFile::ReadBuffer(char* buf, Int_t len)
+{
+  // Baskets already prefetched by a TTreeCache are served from it, as for the other files
+  const Int_t st = ReadBufferViaCache(buf, len);
+  if (st==1) return kFALSE;
+  if (st==2) return kTRUE;
+  const Long64_t pos = fOffset;
+  if (pos < 0 || len < 0 || pos + len > size_) { Error("ReadBuffer", "reading %d bytes at %lld beyond the end of the file", len, pos); return kTRUE; }
+  std::vector<Long64_t> blocks;
+  for (Long64_t b = pos/blockSize_; b*blockSize_ < pos + len; b++) { blocks.push_back(b); }
+  if (Fetch(blocks) || Copy(buf, pos, len)) return kTRUE;
+  fOffset += len;
+  return kFALSE;
+}
+
+Bool_t TCachedFile::ReadBuffer(char* buf, Long64_t pos, Int_t len)
+{
+  fOffset = pos;
+  return ReadBuffer(buf, len);
+}
+
+Bool_t TCachedFile::ReadBuffers(char* buf, Long64_t* pos, Int_t* len, Int_t nbuf)
+{
+  // Gather the blocks of all the pieces (e.g. the baskets of a TTreeCache) to fetch the
+  // missing ones in one vectored read. Without a buffer it is only a prefetch request.
+  std::vector<Long64_t> blocks;
+  for (Int_t i = 0; i < nbuf; i++) {
+    if (pos[i] < 0 || len[i] < 0 || pos[i] + len[i] > size_) { Error("ReadBuffers", "reading %d bytes at %lld beyond the end of the file", len[i], pos[i]); return kTRUE; }
+    for (Long64_t b = pos[i]/blockSize_; b*blockSize_ < pos[i] + len[i]; b++) { blocks.push_back(b); }
+  }
+  std::sort(blocks.begin(), blocks.end());
+  blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+  // All the blocks of the request are kept in memory until they are copied
+  const UInt_t nMem = nMemBlocks_;
+  nMemBlocks_ = std::max(nMemBlocks_, UInt_t(blocks.size()));
+  const Bool_t failed = Fetch(blocks);
+  if (!failed && buf) {
+    for (Int_t i = 0; i < nbuf; i++) {
+      if (Copy(buf, pos[i], len[i])) { nMemBlocks_ = nMem; return kTRUE; }
+      buf += len[i];
+    }
+  }
+  nMemBlocks_ = nMem;
+  while (memory_.size() > nMemBlocks_) { memory_.pop_back(); }
+  return failed;
+}
+
+Bool_t TCachedFile::Fetch(const std::vector<Long64_t>& blocks)
+{
+  // Blocks not in memory are read from the disk cache, or from the remote file
+  std::vector<int64_t> missing;
+  for (auto& b : blocks) { if (!Block(b)) missing.push_back(b); }
+  if (missing.empty()) return kFALSE;
+  std::vector< std::vector<char> > data;
+  if (blockCache_.Get(source_, key_, missing, data)) { Error("Fetch", "failed to read %zu blocks of %s", missing.size(), GetName()); return kTRUE; }
+  for (size_t i = 0; i < missing.size(); i++) {
+    memory_.push_front(std::make_pair(Long64_t(missing[i]), std::vector<char>()));
+    memory_.front().second.swap(data[i]);
+  }
+  while (memory_.size() > nMemBlocks_) { memory_.pop_back(); }
+  return kFALSE;
+}
+
+const char* TCachedFile::Block(const Long64_t b)
+{
+  for (auto it = memory_.begin(); it != memory_.end(); ++it) {
+    if (it->first!=b) continue;
+    if (it != memory_.begin()) memory_.splice(memory_.begin(), memory_, it);
+    return memory_.front().second.data();
+  }
+  return 0;
+}
+
+Bool_t TCachedFile::Copy(char* buf, Long64_t pos, Int_t len)
+{
+  // Copy the bytes from the blocks kept in memory, updating the read statistics
+  const Int_t n = len;
+  while (len > 0) {
+    const Long64_t b = pos/blockSize_;
+    const char* block = Block(b);
+    if (!block) return kTRUE;
+    const Int_t offset = Int_t(pos - b*blockSize_), size = std::min(len, blockSize_ - offset);
+    std::memcpy(buf, block + offset, size);
+    buf += size; pos += size; len -= size;
+  }
+  fBytesRead += n;
+  fReadCalls++;
+  // The global counters are shared by the files of all the I/O threads
+  fgBytesRead += n;
+  fgReadCalls++;
+  return kFALSE;
+}
+
+#endif
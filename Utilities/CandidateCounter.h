@@ -0,0 +1,252 @@
+#ifndef CandidateCounter_h
+#define CandidateCounter_h
+
+// Header file for ROOT classes
+#include <Rtypes.h>
+#include <TDirectory.h>
+#include <TParameter.h>
+#include <TH1.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <bitset>
+#include <algorithm>
+#include <cmath>
+
+
+// Set of small object indices, backed by a fixed bitset with a fallback for large indices
+template <size_t N>
+class IndexSet {
+
+ public :
+
+  // Return true if the index was not yet in the set
+  bool Insert(const size_t i) {
+    if (i < N) {
+      if (bits_.test(i)) return false;
+      bits_.set(i);
+      return true;
+    }
+    if (std::find(overflow_.begin(), overflow_.end(), i) != overflow_.end()) return false;
+    overflow_.push_back(i);
+    return true;
+  }
+  void Clear(void) { bits_.reset(); overflow_.clear(); }
+
+ private:
+
+  std::bitset<N>        bits_;
+  std::vector<size_t>   overflow_;
+};
+
+
+class CandidateCounter {
+
+ public :
+
+  CandidateCounter(const size_t maxMult=32);
+  virtual ~CandidateCounter() {};
+
+  virtual void         NewEvent      (void);
+  virtual void         Add           (const size_t iDiMuon, const size_t iConv);
+  virtual void         EndEvent      (void);
+  virtual void         Merge         (const CandidateCounter&);
+  virtual void         Print         (const std::string& label="") const;
+  virtual Bool_t       Write         (TDirectory*) const;
+  virtual Bool_t       Read          (TDirectory*);
+
+  ULong64_t            GetNEvents    (void) const { return nEvents_;     }
+  ULong64_t            GetNCandidates(void) const { return nCandidates_; }
+  ULong64_t            GetNDiMuons   (void) const { return nDiMuons_;    }
+  ULong64_t            GetNConv      (void) const { return nConv_;       }
+
+  // Multiplicity distributions: the last bin holds the overflow
+  const std::vector<ULong64_t>& CandidatesPerEvent  (void) const { return perEvent_;  }
+  const std::vector<ULong64_t>& CandidatesPerDiMuon (void) const { return perDiMuon_; }
+  const std::vector<ULong64_t>& CandidatesPerConv   (void) const { return perConv_;   }
+
+  // Fraction of the dimuons (conversions) used by more than one candidate
+  double               SharedDiMuonFraction (void) const { return (nDiMuons_>0 ? double(nSharedDiMuons_)/nDiMuons_ : 0.); }
+  double               SharedConvFraction   (void) const { return (nConv_   >0 ? double(nSharedConv_   )/nConv_    : 0.); }
+
+ private:
+
+  void                 Count         (std::vector<UShort_t>&, std::vector<size_t>&, std::vector<ULong64_t>&, ULong64_t&);
+
+  // PER-EVENT BOOKKEEPING
+  IndexSet<256>              diMuonSet_;
+  IndexSet<256>              convSet_;
+  std::vector<size_t>        diMuonIdx_;
+  std::vector<size_t>        convIdx_;
+  std::vector<UShort_t>      diMuonCount_;
+  std::vector<UShort_t>      convCount_;
+  size_t                     nEvtCandidates_;
+
+  // GLOBAL COUNTERS
+  ULong64_t                  nEvents_;
+  ULong64_t                  nCandidates_;
+  ULong64_t                  nDiMuons_;
+  ULong64_t                  nConv_;
+  ULong64_t                  nSharedDiMuons_;
+  ULong64_t                  nSharedConv_;
+  std::vector<ULong64_t>     perEvent_;
+  std::vector<ULong64_t>     perDiMuon_;
+  std::vector<ULong64_t>     perConv_;
+};
+
+CandidateCounter::CandidateCounter(const size_t maxMult) :
+  nEvtCandidates_(0), nEvents_(0), nCandidates_(0), nDiMuons_(0), nConv_(0), nSharedDiMuons_(0), nSharedConv_(0),
+  perEvent_(maxMult+1, 0), perDiMuon_(maxMult+1, 0), perConv_(maxMult+1, 0)
+{
+}
+
+void CandidateCounter::NewEvent(void)
+{
+  diMuonSet_.Clear();
+  convSet_.Clear();
+  diMuonIdx_.clear();
+  convIdx_.clear();
+  nEvtCandidates_ = 0;
+}
+
+void CandidateCounter::Add(const size_t iDiMuon, const size_t iConv)
+{
+  nEvtCandidates_++;
+  if (diMuonSet_.Insert(iDiMuon)) {
+    diMuonIdx_.push_back(iDiMuon);
+    if (iDiMuon >= diMuonCount_.size()) diMuonCount_.resize(iDiMuon+1, 0);
+  }
+  if (convSet_.Insert(iConv)) {
+    convIdx_.push_back(iConv);
+    if (iConv >= convCount_.size()) convCount_.resize(iConv+1, 0);
+  }
+  diMuonCount_[iDiMuon]++;
+  convCount_[iConv]++;
+}
+
+void CandidateCounter::EndEvent(void)
+{
+  nEvents_++;
+  if (nEvtCandidates_==0) return;
+  nCandidates_ += nEvtCandidates_;
+  perEvent_[std::min(nEvtCandidates_, perEvent_.size()-1)]++;
+  nDiMuons_ += diMuonIdx_.size();
+  nConv_    += convIdx_.size();
+  Count(diMuonCount_, diMuonIdx_, perDiMuon_, nSharedDiMuons_);
+  Count(convCount_,   convIdx_,   perConv_,   nSharedConv_);
+  NewEvent();
+}
+
+void CandidateCounter::Count(std::vector<UShort_t>& count, std::vector<size_t>& index, std::vector<ULong64_t>& dist, ULong64_t& nShared)
+{
+  for (auto& i : index) {
+    dist[std::min(size_t(count[i]), dist.size()-1)]++;
+    if (count[i] > 1) nShared++;
+    count[i] = 0;
+  }
+}
+
+void CandidateCounter::Merge(const CandidateCounter& other)
+{
+  nEvents_        += other.nEvents_;
+  nCandidates_    += other.nCandidates_;
+  nDiMuons_       += other.nDiMuons_;
+  nConv_          += other.nConv_;
+  nSharedDiMuons_ += other.nSharedDiMuons_;
+  nSharedConv_    += other.nSharedConv_;
+  auto add = [](std::vector<ULong64_t>& a, const std::vector<ULong64_t>& b) {
+    if (b.size() > a.size()) { a.resize(b.size(), 0); }
+    for (size_t i = 0; i < b.size(); i++) { a[i] += b[i]; }
+  };
+  add(perEvent_,  other.perEvent_);
+  add(perDiMuon_, other.perDiMuon_);
+  add(perConv_,   other.perConv_);
+}
+
+Bool_t CandidateCounter::Write(TDirectory* dir) const
+{
+  // Summed by hadd and TFileMerger when merging partial outputs
+  if (!dir) return false;
+  const std::vector< std::pair<std::string, ULong64_t> > counters = {
+    { "nEvents" , nEvents_ } , { "nCandidates" , nCandidates_ } , { "nDiMuons" , nDiMuons_ } ,
+    { "nConv" , nConv_ } , { "nSharedDiMuons" , nSharedDiMuons_ } , { "nSharedConv" , nSharedConv_ }
+  };
+  for (auto& c : counters) {
+    TParameter<Long64_t> par(c.first.c_str(), Long64_t(c.second), '+');
+    dir->WriteTObject(&par, c.first.c_str(), "Overwrite");
+  }
+  // The multiplicity distributions are histograms, in their own directory so that they are
+  // not read back as variables by Histogram::Read
+  TDirectory* multDir = dir->GetDirectory("Multiplicity");
+  if (!multDir) multDir = dir->mkdir("Multiplicity");
+  if (!multDir) return false;
+  const std::vector< std::pair<std::string, const std::vector<ULong64_t>*> > dists = {
+    { "CandidatesPerEvent" , &perEvent_ } , { "CandidatesPerDiMuon" , &perDiMuon_ } , { "CandidatesPerConv" , &perConv_ }
+  };
+  for (auto& d : dists) {
+    const std::vector<ULong64_t>& dist = *d.second;
+    TH1D h(d.first.c_str(), d.first.c_str(), dist.size(), -0.5, dist.size()-0.5);
+    h.SetDirectory(0);
+    ULong64_t entries = 0;
+    for (size_t i = 0; i < dist.size(); i++) { h.SetBinContent(i+1, double(dist[i])); entries += dist[i]; }
+    h.SetEntries(double(entries));
+    multDir->WriteTObject(&h, d.first.c_str(), "Overwrite");
+  }
+  return true;
+}
+
+Bool_t CandidateCounter::Read(TDirectory* dir)
+{
+  // Add the counters and multiplicity distributions stored by Write
+  if (!dir) return false;
+  const std::vector< std::pair<std::string, ULong64_t*> > counters = {
+    { "nEvents" , &nEvents_ } , { "nCandidates" , &nCandidates_ } , { "nDiMuons" , &nDiMuons_ } ,
+    { "nConv" , &nConv_ } , { "nSharedDiMuons" , &nSharedDiMuons_ } , { "nSharedConv" , &nSharedConv_ }
+  };
+  for (auto& c : counters) {
+    TParameter<Long64_t>* par = 0;
+    dir->GetObject(c.first.c_str(), par);
+    if (!par) { std::cout << "[ERROR] Counter " << c.first << " not found in " << dir->GetName() << std::endl; return false; }
+    *c.second += par->GetVal();
+    delete par;
+  }
+  // Outputs written before the distributions were stored only have the counters
+  TDirectory* multDir = dir->GetDirectory("Multiplicity");
+  if (!multDir) return true;
+  const std::vector< std::pair<std::string, std::vector<ULong64_t>*> > dists = {
+    { "CandidatesPerEvent" , &perEvent_ } , { "CandidatesPerDiMuon" , &perDiMuon_ } , { "CandidatesPerConv" , &perConv_ }
+  };
+  for (auto& d : dists) {
+    TH1D* h = 0;
+    multDir->GetObject(d.first.c_str(), h);
+    if (!h) { std::cout << "[ERROR] Distribution " << d.first << " not found in " << dir->GetName() << std::endl; return false; }
+    h->SetDirectory(0);
+    std::vector<ULong64_t>& dist = *d.second;
+    if (size_t(h->GetNbinsX()) > dist.size()) dist.resize(h->GetNbinsX(), 0);
+    for (Int_t i = 0; i < h->GetNbinsX(); i++) { dist[i] += ULong64_t(std::llround(h->GetBinContent(i+1))); }
+    delete h;
+  }
+  return true;
+}
+
+void CandidateCounter::Print(const std::string& label) const
+{
+  const std::streamsize precision = std::cout.precision();
+  std::cout << "[INFO] Candidate multiplicity " << label << " : " << nCandidates_ << " candidates in " << nEvents_ << " events, "
+            << nDiMuons_ << " dimuons (" << std::setprecision(3) << 100.*SharedDiMuonFraction() << "% shared), "
+            << nConv_ << " conversions (" << 100.*SharedConvFraction() << "% shared)" << std::endl;
+  std::cout << std::setprecision(precision);
+  auto print = [](const std::string& name, const std::vector<ULong64_t>& dist) {
+    std::cout << "[INFO]   Candidates per " << name << " :";
+    for (size_t i = 1; i < dist.size(); i++) { if (dist[i]>0) std::cout << " " << i << (i+1==dist.size() ? "+" : "") << ":" << dist[i]; }
+    std::cout << std::endl;
+  };
+  print("event     ", perEvent_);
+  print("dimuon    ", perDiMuon_);
+  print("conversion", perConv_);
+}
+
+#endif
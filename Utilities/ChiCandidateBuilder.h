@@ -0,0 +1,155 @@
+#ifndef ChiCandidateBuilder_h
+#define ChiCandidateBuilder_h
+
+// Header file for ROOT classes
+#include <TLorentzVector.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+// Header file for the decoded events
+#include "ChiEvent.h"
+
+
+// Treatment of the dimuon mass when computing the chi mass
+enum ChiConstraint {
+  kNoConstraint   = 0, // m(mumu gamma)
+  kDeltaMass      = 1, // m(mumu gamma) - m(mumu) + m_PDG
+  kMassConstraint = 2  // m(mumu gamma) with the dimuon energy recomputed using m_PDG
+};
+
+typedef struct ChiBuildConfig {
+  std::string   name;
+  UChar_t       type;
+  double        diMuonMassMin;
+  double        diMuonMassMax;
+  double        diMuonMassPDG;
+  ChiConstraint constraint;
+  double        chiMassMin;
+  double        chiMassMax;
+} ChiBuildConfig;
+
+typedef struct ChiCandidate {
+  Float_t       mass;
+  UShort_t      diMuonIdx;
+  UShort_t      convIdx;
+  UChar_t       type;
+} ChiCandidate;
+
+
+class ChiCandidateBuilder {
+
+ public :
+
+  ChiCandidateBuilder(const std::vector< ChiBuildConfig >&);
+  virtual ~ChiCandidateBuilder() {};
+
+  virtual void                              Build      (const ChiEvent&);
+  virtual size_t                            GetN       (void) { return config_.size(); }
+  virtual const ChiBuildConfig&             Config     (const size_t i) { return config_.at(i); }
+  virtual const std::vector<ChiCandidate>&  Candidates (const size_t i) { return candidates_.at(i); }
+
+  // Conversion photons found in the last event, one entry per conversion index
+  virtual size_t                            GetNConv   (void) { return convIdx_.size(); }
+  virtual UShort_t                          ConvIdx    (const size_t i) { return convIdx_[i]; }
+  virtual TLorentzVector                    ConvMom    (const size_t i) { return TLorentzVector(cvPx_[i], cvPy_[i], cvPz_[i], cvE_[i]); }
+  // Position of a conversion index in the list above, -1 if not found in the last event
+  virtual int                               ConvSlot   (const UShort_t iConv) { return (iConv < convSlot_.size() ? convSlot_[iConv] : -1); }
+
+ private:
+
+  virtual void                              LoadDiMuons     (const ChiEvent&);
+  virtual void                              LoadConversions (const ChiEvent&);
+  virtual void                              Combine         (const ChiBuildConfig&, const size_t, std::vector<ChiCandidate>&);
+
+  std::vector< ChiBuildConfig >               config_;
+  std::vector< std::vector<ChiCandidate> >    candidates_;
+
+  // DIMUON BUFFERS (one entry per Reco_DiMuon_Mom)
+  std::vector<double>    dmPx_, dmPy_, dmPz_, dmE_, dmM_;
+  // CONVERSION BUFFERS (one entry per conversion)
+  std::vector<double>    cvPx_, cvPy_, cvPz_, cvE_;
+  std::vector<UShort_t>  convIdx_;
+  std::vector<int>       convSlot_;
+  // PAIR MASS BUFFER (one entry per conversion)
+  std::vector<double>    mass_;
+};
+
+ChiCandidateBuilder::ChiCandidateBuilder(const std::vector< ChiBuildConfig >& config) : config_(config)
+{
+  candidates_.resize(config_.size());
+}
+
+void ChiCandidateBuilder::Build(const ChiEvent& evt)
+{
+  LoadDiMuons(evt);
+  LoadConversions(evt);
+  for (size_t iCfg = 0; iCfg < config_.size(); iCfg++) {
+    candidates_[iCfg].clear();
+    for (size_t iDM = 0; iDM < dmM_.size(); iDM++) {
+      if (dmM_[iDM] < config_[iCfg].diMuonMassMin || dmM_[iDM] > config_[iCfg].diMuonMassMax) continue;
+      Combine(config_[iCfg], iDM, candidates_[iCfg]);
+    }
+  }
+}
+
+void ChiCandidateBuilder::LoadDiMuons(const ChiEvent& evt)
+{
+  const size_t n = evt.Reco_DiMuon_Mom.size();
+  dmPx_.resize(n); dmPy_.resize(n); dmPz_.resize(n); dmE_.resize(n); dmM_.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    const TLorentzVector& p = evt.Reco_DiMuon_Mom[i];
+    dmPx_[i] = p.Px(); dmPy_[i] = p.Py(); dmPz_[i] = p.Pz(); dmE_[i] = p.E(); dmM_[i] = p.M();
+  }
+}
+
+void ChiCandidateBuilder::LoadConversions(const ChiEvent& evt)
+{
+  // The forest only stores the photon inside the dimuon-conversion pairs:
+  // recover it as p(mumu gamma) - p(mumu), once per conversion index
+  for (auto& iConv : convIdx_) { convSlot_[iConv] = -1; }
+  cvPx_.clear(); cvPy_.clear(); cvPz_.clear(); cvE_.clear();
+  convIdx_.clear();
+  for (size_t i = 0; i < evt.Reco_DiMuonConv_Conversion_Idx.size(); i++) {
+    const UShort_t iConv = evt.Reco_DiMuonConv_Conversion_Idx[i];
+    const UShort_t iDM   = evt.Reco_DiMuonConv_DiMuon_Idx[i];
+    if (iDM >= evt.Reco_DiMuon_Mom.size() || i >= evt.Reco_DiMuonConv_Mom.size()) continue;
+    if (iConv >= convSlot_.size()) convSlot_.resize(iConv+1, -1);
+    if (convSlot_[iConv] >= 0) continue;
+    convSlot_[iConv] = convIdx_.size();
+    const TLorentzVector& pChi = evt.Reco_DiMuonConv_Mom[i];
+    const TLorentzVector& pDM  = evt.Reco_DiMuon_Mom[iDM];
+    cvPx_.push_back(pChi.Px() - pDM.Px());
+    cvPy_.push_back(pChi.Py() - pDM.Py());
+    cvPz_.push_back(pChi.Pz() - pDM.Pz());
+    cvE_.push_back (pChi.E()  - pDM.E() );
+    convIdx_.push_back(iConv);
+  }
+  mass_.resize(convIdx_.size());
+}
+
+void ChiCandidateBuilder::Combine(const ChiBuildConfig& config, const size_t iDM, std::vector<ChiCandidate>& output)
+{
+  const size_t n = convIdx_.size();
+  const double px = dmPx_[iDM], py = dmPy_[iDM], pz = dmPz_[iDM];
+  double e = dmE_[iDM], offset = 0.;
+  if (config.constraint == kMassConstraint) { e = std::sqrt(px*px + py*py + pz*pz + config.diMuonMassPDG*config.diMuonMassPDG); }
+  if (config.constraint == kDeltaMass     ) { offset = config.diMuonMassPDG - dmM_[iDM]; }
+  // Branch-free loop over all the conversions of the event, vectorized by the compiler
+  const double* cx = cvPx_.data(); const double* cy = cvPy_.data(); const double* cz = cvPz_.data(); const double* ce = cvE_.data();
+  double* m = mass_.data();
+  for (size_t i = 0; i < n; i++) {
+    const double sx = px + cx[i], sy = py + cy[i], sz = pz + cz[i], se = e + ce[i];
+    const double m2 = se*se - sx*sx - sy*sy - sz*sz;
+    m[i] = std::sqrt(m2 > 0. ? m2 : 0.) + offset;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (m[i] < config.chiMassMin || m[i] > config.chiMassMax) continue;
+    output.push_back({ Float_t(m[i]), UShort_t(iDM), convIdx_[i], config.type });
+  }
+}
+
+#endif
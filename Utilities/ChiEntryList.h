@@ -0,0 +1,121 @@
+#ifndef ChiEntryList_h
+#define ChiEntryList_h
+
+// Header file for ROOT classes
+#include <TFile.h>
+#include <TTree.h>
+#include <TEntryList.h>
+#include <TMD5.h>
+#include <TSystem.h>
+#include <TKey.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+
+// Header file for the forest readers
+#include "HiForestTree.h"
+
+
+// Entries of a forest with at least one chi candidate, in total (type 0) and per chi type.
+// The lists are built by the conversion reader the first time a file is read, and saved in a
+// local directory under the MD5 of the file name, UUID and conversion tree sizes, so that a
+// rewritten file gets new lists.
+class ChiEntryList {
+
+ public :
+
+  ChiEntryList() {};
+  virtual ~ChiEntryList() {};
+
+  static std::string   Key       (TFile*, const std::string& fileName);
+  virtual Bool_t       Get       (const std::string& dir, const std::string& fileName, HiForestTree&);
+  // Sorted entries with a candidate of the given type, 0 if the type has no candidate
+  const std::vector<Long64_t>* Entries (const int type=0) const { return (entries_.count(type)>0 ? &entries_.at(type) : 0); }
+
+ private:
+
+  virtual Bool_t       Read      (const std::string&);
+  virtual Bool_t       Write     (const std::string&) const;
+
+  std::map< int , std::vector<Long64_t> >        entries_;
+};
+
+std::string ChiEntryList::Key(TFile* file, const std::string& fileName)
+{
+  std::stringstream ss;
+  ss << fileName << "|" << file->GetUUID().AsString();
+  for (auto& name : { "convAna/Conversion_Event" , "convAna/Conversion_Reco" }) {
+    TTree* tree = 0;
+    file->GetObject(name, tree);
+    if (tree) ss << "|" << name << ":" << tree->GetEntries() << ":" << tree->GetTotBytes() << ":" << tree->GetZipBytes();
+  }
+  const std::string id = ss.str();
+  TMD5 md5;
+  md5.Update(reinterpret_cast<const UChar_t*>(id.data()), id.size());
+  md5.Final();
+  return md5.AsString();
+}
+
+Bool_t ChiEntryList::Get(const std::string& dir, const std::string& fileName, HiForestTree& forest)
+{
+  if (!forest.File()) return false;
+  const std::string path = dir + "/" + Key(forest.File(), fileName) + ".root";
+  if (!gSystem->AccessPathName(path.c_str()) && Read(path)) {
+    std::cout << "[INFO] Using the entry lists " << path << " of " << fileName << std::endl;
+    return true;
+  }
+  std::cout << "[INFO] Listing the entries with chi candidates of " << fileName << std::endl;
+  if (!forest.Conv().ScanEntries(entries_)) return false;
+  gSystem->mkdir(dir.c_str(), kTRUE);
+  // Not being able to save the lists only costs a scan in the next passes
+  if (Write(path)) std::cout << "[INFO] Entry lists saved in " << path << std::endl;
+  return true;
+}
+
+Bool_t ChiEntryList::Read(const std::string& path)
+{
+  entries_.clear();
+  std::unique_ptr<TFile> file(TFile::Open(path.c_str(), "READ"));
+  if (!file || !file->IsOpen()) return false;
+  TIter next(file->GetListOfKeys());
+  while (TKey* key = (TKey*)next()) {
+    const std::string name = key->GetName();
+    if (name.find("ChiType")!=0) continue;
+    TEntryList* list = 0;
+    file->GetObject(name.c_str(), list);
+    if (!list) return false;
+    std::vector<Long64_t>& entries = entries_[std::stoi(name.substr(7))];
+    entries.resize(list->GetN());
+    for (Long64_t i = 0; i < list->GetN(); i++) { entries[i] = list->GetEntry(i); }
+    delete list;
+  }
+  // The list of all the entries with candidates is always written, even if empty
+  return (entries_.count(0)>0);
+}
+
+Bool_t ChiEntryList::Write(const std::string& path) const
+{
+  // Written to a temporary file first, so that other jobs never read partial lists
+  const std::string tmp = path + Form(".tmp.%d", gSystem->GetPid());
+  {
+    std::unique_ptr<TFile> file(TFile::Open(tmp.c_str(), "RECREATE"));
+    if (!file || !file->IsOpen()) { std::cout << "[ERROR] Failed to create the entry lists " << tmp << std::endl; return false; }
+    for (auto& type : entries_) {
+      const std::string name = Form("ChiType%d", type.first);
+      TEntryList list(name.c_str(), Form("Entries with chi candidates of type %d (0: any)", type.first));
+      for (auto& entry : type.second) { list.Enter(entry); }
+      file->WriteTObject(&list, name.c_str(), "Overwrite");
+    }
+    file->Close();
+  }
+  if (gSystem->Rename(tmp.c_str(), path.c_str())!=0) { gSystem->Unlink(tmp.c_str()); return false; }
+  return true;
+}
+
+#endif
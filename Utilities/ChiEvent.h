@@ -0,0 +1,149 @@
+#ifndef ChiEvent_h
+#define ChiEvent_h
+
+// Header file for ROOT classes
+#include <TLorentzVector.h>
+
+// Header file for c++ classes
+#include <vector>
+#include <stdexcept>
+
+// Header file for the derived quantities
+#include "KinematicCache.h"
+
+// Read-only view of consecutive values of a column, used as a std::vector
+template <typename T>
+class ChiSpan {
+
+ public :
+
+  ChiSpan() : data_(0), size_(0) {};
+  ChiSpan(const T* data, const size_t size) : data_(data), size_(size) {};
+
+  size_t               size       (void) const { return size_; }
+  bool                 empty      (void) const { return (size_==0); }
+  const T*             data       (void) const { return data_; }
+  const T*             begin      (void) const { return data_; }
+  const T*             end        (void) const { return data_ + size_; }
+  const T&             operator[] (const size_t i) const { return data_[i]; }
+  const T&             at         (const size_t i) const { if (i >= size_) throw std::out_of_range("ChiSpan::at"); return data_[i]; }
+
+ private:
+
+  const T*             data_;
+  size_t               size_;
+};
+
+// Content of one forest entry, named after the branches it comes from, pointing to the
+// columns of the ChiEventBlock it belongs to
+typedef struct ChiEvent {
+  Long64_t                   entry;
+  UInt_t                     Event_Run;
+  ULong64_t                  Event_Number;
+  UChar_t                    Event_nPV;
+  Float_t                    Event_PriVtx_Z;
+  ChiSpan<TLorentzVector>    Reco_Muon_Mom;
+  ChiSpan<TLorentzVector>    Reco_DiMuon_Mom;
+  ChiSpan<char>              Reco_DiMuon_Charge;
+  ChiSpan<UChar_t>           Reco_DiMuon_Muon1_Idx;
+  ChiSpan<UChar_t>           Reco_DiMuon_Muon2_Idx;
+  ChiSpan<TLorentzVector>    Reco_DiMuonConv_Mom;
+  ChiSpan<UShort_t>          Reco_DiMuonConv_Conversion_Idx;
+  ChiSpan<UShort_t>          Reco_DiMuonConv_DiMuon_Idx;
+  ChiSpan<Float_t>           Reco_Chi_Mass;
+  ChiSpan<UChar_t>           Reco_Chi_Type;
+} ChiEvent;
+
+// Decoded content of consecutive forest entries, stored by column: one value per event for
+// the event branches, and the values of all the events one after the other for the jagged
+// branches. The values of event i are in [Offset[i], Offset[i+1]) of the columns of their
+// collection: muons, dimuons, and chi candidates (Reco_DiMuonConv_* and Reco_Chi_*). The
+// primary vertex (Event_nPV, Event_PriVtx_Z) is only read with the candidates, zero otherwise.
+// The gen columns are only filled for MC samples read with their gen branches: Reco_Muon_Gen_Idx
+// follows the muon offsets, the gen muons and gen particles have their own offsets.
+// The pt, eta, phi, rapidity and mass of the muons, dimuons and candidates (Reco_DiMuonConv_Mom)
+// are computed on first request, indexed as the columns, and invalidated when the block is cleared.
+typedef struct ChiEventBlock {
+  std::vector<Long64_t>      entry;
+  std::vector<UInt_t>        Event_Run;
+  std::vector<ULong64_t>     Event_Number;
+  std::vector<UChar_t>       Event_nPV;
+  std::vector<Float_t>       Event_PriVtx_Z;
+  std::vector<UInt_t>        Muon_Offset;
+  std::vector<UInt_t>        DiMuon_Offset;
+  std::vector<UInt_t>        Chi_Offset;
+  VTLorentzVector            Reco_Muon_Mom;
+  VTLorentzVector            Reco_DiMuon_Mom;
+  std::vector<char>          Reco_DiMuon_Charge;
+  std::vector<UChar_t>       Reco_DiMuon_Muon1_Idx;
+  std::vector<UChar_t>       Reco_DiMuon_Muon2_Idx;
+  VTLorentzVector            Reco_DiMuonConv_Mom;
+  std::vector<UShort_t>      Reco_DiMuonConv_Conversion_Idx;
+  std::vector<UShort_t>      Reco_DiMuonConv_DiMuon_Idx;
+  std::vector<Float_t>       Reco_Chi_Mass;
+  std::vector<UChar_t>       Reco_Chi_Type;
+  std::vector<UInt_t>        GenMuon_Offset;
+  std::vector<UInt_t>        Gen_Offset;
+  std::vector<char>          Reco_Muon_Gen_Idx;
+  std::vector<UShort_t>      Gen_Muon_Particle_Idx;
+  std::vector<int>           Gen_Particle_PdgId;
+  std::vector<UShort_t>      Gen_Particle_Mother_Idx;   // first mother only, 0xFFFF if none
+  VTLorentzVector            Gen_Particle_Mom;
+  // Derived quantities, only used by the thread processing the block
+  mutable KinematicCache     Muon_Kin;
+  mutable KinematicCache     DiMuon_Kin;
+  mutable KinematicCache     Chi_Kin;
+
+  size_t Size(void) const { return entry.size(); }
+  double        MuonKin      (const KinVar var, const size_t i) const { return Muon_Kin.Get(Reco_Muon_Mom, var, i); }
+  double        DiMuonKin    (const KinVar var, const size_t i) const { return DiMuon_Kin.Get(Reco_DiMuon_Mom, var, i); }
+  double        ChiKin       (const KinVar var, const size_t i) const { return Chi_Kin.Get(Reco_DiMuonConv_Mom, var, i); }
+  // Values of the whole block, indexed as the columns
+  const double* MuonKinAll   (const KinVar var) const { return Muon_Kin.All(Reco_Muon_Mom, var); }
+  const double* DiMuonKinAll (const KinVar var) const { return DiMuon_Kin.All(Reco_DiMuon_Mom, var); }
+  const double* ChiKinAll    (const KinVar var) const { return Chi_Kin.All(Reco_DiMuonConv_Mom, var); }
+  // Start a new block, keeping the memory of the columns
+  void Clear(void) {
+    entry.clear(); Event_Run.clear(); Event_Number.clear(); Event_nPV.clear(); Event_PriVtx_Z.clear();
+    Muon_Offset.assign(1, 0); DiMuon_Offset.assign(1, 0); Chi_Offset.assign(1, 0);
+    GenMuon_Offset.assign(1, 0); Gen_Offset.assign(1, 0);
+    Reco_Muon_Mom.clear(); Reco_DiMuon_Mom.clear(); Reco_DiMuon_Charge.clear(); Reco_DiMuon_Muon1_Idx.clear(); Reco_DiMuon_Muon2_Idx.clear();
+    Reco_DiMuonConv_Mom.clear(); Reco_DiMuonConv_Conversion_Idx.clear(); Reco_DiMuonConv_DiMuon_Idx.clear();
+    Reco_Chi_Mass.clear(); Reco_Chi_Type.clear();
+    Reco_Muon_Gen_Idx.clear(); Gen_Muon_Particle_Idx.clear();
+    Gen_Particle_PdgId.clear(); Gen_Particle_Mother_Idx.clear(); Gen_Particle_Mom.clear();
+    Muon_Kin.Invalidate(); DiMuon_Kin.Invalidate(); Chi_Kin.Invalidate();
+  }
+  // Close the collections of the last event added to the columns
+  void EndEvent(void) {
+    Muon_Offset.push_back(Reco_Muon_Mom.size());
+    DiMuon_Offset.push_back(Reco_DiMuon_Mom.size());
+    Chi_Offset.push_back(Reco_Chi_Type.size());
+    GenMuon_Offset.push_back(Gen_Muon_Particle_Idx.size());
+    Gen_Offset.push_back(Gen_Particle_PdgId.size());
+  }
+  ChiEvent Event(const size_t i) const {
+    const UInt_t m = Muon_Offset[i], nM = Muon_Offset[i+1] - m;
+    const UInt_t d = DiMuon_Offset[i], nD = DiMuon_Offset[i+1] - d;
+    const UInt_t c = Chi_Offset[i], nC = Chi_Offset[i+1] - c;
+    ChiEvent evt;
+    evt.entry                          = entry[i];
+    evt.Event_Run                      = Event_Run[i];
+    evt.Event_Number                   = Event_Number[i];
+    evt.Event_nPV                      = Event_nPV[i];
+    evt.Event_PriVtx_Z                 = Event_PriVtx_Z[i];
+    evt.Reco_Muon_Mom                  = ChiSpan<TLorentzVector>(Reco_Muon_Mom.data() + m, nM);
+    evt.Reco_DiMuon_Mom                = ChiSpan<TLorentzVector>(Reco_DiMuon_Mom.data() + d, nD);
+    evt.Reco_DiMuon_Charge             = ChiSpan<char>(Reco_DiMuon_Charge.data() + d, nD);
+    evt.Reco_DiMuon_Muon1_Idx          = ChiSpan<UChar_t>(Reco_DiMuon_Muon1_Idx.data() + d, nD);
+    evt.Reco_DiMuon_Muon2_Idx          = ChiSpan<UChar_t>(Reco_DiMuon_Muon2_Idx.data() + d, nD);
+    evt.Reco_DiMuonConv_Mom            = ChiSpan<TLorentzVector>(Reco_DiMuonConv_Mom.data() + c, nC);
+    evt.Reco_DiMuonConv_Conversion_Idx = ChiSpan<UShort_t>(Reco_DiMuonConv_Conversion_Idx.data() + c, nC);
+    evt.Reco_DiMuonConv_DiMuon_Idx     = ChiSpan<UShort_t>(Reco_DiMuonConv_DiMuon_Idx.data() + c, nC);
+    evt.Reco_Chi_Mass                  = ChiSpan<Float_t>(Reco_Chi_Mass.data() + c, nC);
+    evt.Reco_Chi_Type                  = ChiSpan<UChar_t>(Reco_Chi_Type.data() + c, nC);
+    return evt;
+  }
+} ChiEventBlock;
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef ChiEventMixer_h
+#define ChiEventMixer_h
+
+// Header file for ROOT classes
+#include <TLorentzVector.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Header file for the chi candidates
+#include "ChiEvent.h"
+#include "ChiCandidateBuilder.h"
+
+
+// Event classes and size of the mixing pools
+typedef struct MixingConfig {
+  UInt_t               nZBin;       // primary vertex z bins in [zMin, zMax] (cm)
+  double               zMin;
+  double               zMax;
+  std::vector<UInt_t>  nPVEdges;    // lower edges of the Event_nPV classes
+  UInt_t               capacity;    // events kept per pool, the oldest one is replaced
+  UInt_t               depth;       // pooled events mixed with each event
+  UInt_t               maxConv;     // conversions kept per pooled event
+} MixingConfig;
+
+
+// Combinatorial background of the chi candidates: the dimuons of an event are combined, with
+// the mass windows and constraints of the rebuilt candidates, with the conversions of the last
+// events of the same class (primary vertex z and number of vertices). Each class has a ring
+// buffer of fixed capacity, allocated on first use, so that the memory is bounded whatever the
+// number of events. The pools belong to the mixer: each event loop uses its own mixer, cleared
+// between samples, and no lock is needed. The mixed candidates depend on the order of the events
+// given to Mix: the events must come in entry order (e.g. EventPrefetcher::Start with ordered)
+// for the result to be reproducible, whatever the number of I/O threads.
+class ChiEventMixer {
+
+ public :
+
+  ChiEventMixer(const std::vector< ChiBuildConfig >&, const MixingConfig&);
+  virtual ~ChiEventMixer() {};
+
+  virtual int                               Pool       (const ChiEvent&) const;
+  virtual void                              Mix        (const ChiEvent&, ChiCandidateBuilder&);
+  virtual void                              Clear      (void);
+  virtual size_t                            GetN       (void) { return config_.size(); }
+  // Mixed candidates of the last event, diMuonIdx is the dimuon of the event, convIdx is unused
+  virtual const std::vector<ChiCandidate>&  Candidates (const size_t i) { return candidates_.at(i); }
+
+ private:
+
+  typedef struct MixingPool {
+    std::vector<float>     px, py, pz, e;   // capacity x maxConv conversions
+    std::vector<UShort_t>  nConv;           // conversions of each pooled event
+    UInt_t                 next;            // slot of the next event
+    UInt_t                 size;            // events in the pool
+  } MixingPool;
+
+  virtual void                              Add        (MixingPool&, ChiCandidateBuilder&);
+
+  std::vector< ChiBuildConfig >               config_;
+  MixingConfig                                mixing_;
+  std::vector< MixingPool >                   pools_;
+  std::vector< std::vector<ChiCandidate> >    candidates_;
+};
+
+ChiEventMixer::ChiEventMixer(const std::vector< ChiBuildConfig >& config, const MixingConfig& mixing) : config_(config), mixing_(mixing)
+{
+  if (mixing_.nZBin==0) mixing_.nZBin = 1;
+  if (mixing_.nPVEdges.empty()) mixing_.nPVEdges = { 0 };
+  if (mixing_.capacity==0) mixing_.capacity = 1;
+  mixing_.depth = std::min(mixing_.depth, mixing_.capacity);
+  pools_.resize(mixing_.nZBin*mixing_.nPVEdges.size());
+  candidates_.resize(config_.size());
+  Clear();
+}
+
+int ChiEventMixer::Pool(const ChiEvent& evt) const
+{
+  // Events outside of the z range (or without a valid vertex) or below the first nPV class are not mixed
+  if (!std::isfinite(evt.Event_PriVtx_Z)) return -1;
+  if (evt.Event_PriVtx_Z < mixing_.zMin || evt.Event_PriVtx_Z >= mixing_.zMax) return -1;
+  if (evt.Event_nPV < mixing_.nPVEdges[0]) return -1;
+  const int iZ = std::min(int(mixing_.nZBin*(evt.Event_PriVtx_Z - mixing_.zMin)/(mixing_.zMax - mixing_.zMin)), int(mixing_.nZBin)-1);
+  const int iPV = int(std::upper_bound(mixing_.nPVEdges.begin(), mixing_.nPVEdges.end(), UInt_t(evt.Event_nPV)) - mixing_.nPVEdges.begin()) - 1;
+  return iZ*mixing_.nPVEdges.size() + iPV;
+}
+
+void ChiEventMixer::Clear(void)
+{
+  // Keep the memory of the pools already used
+  for (auto& pool : pools_) { pool.next = 0; pool.size = 0; }
+  for (auto& cands : candidates_) { cands.clear(); }
+}
+
+void ChiEventMixer::Mix(const ChiEvent& evt, ChiCandidateBuilder& builder)
+{
+  // The conversions of the event are taken from the builder, which must have built it
+  for (auto& cands : candidates_) { cands.clear(); }
+  const int iPool = Pool(evt);
+  if (iPool < 0 || (evt.Reco_DiMuon_Mom.empty() && builder.GetNConv()==0)) return;
+  MixingPool& pool = pools_[iPool];
+  const UInt_t maxConv = mixing_.maxConv;
+  for (size_t iCfg = 0; iCfg < config_.size(); iCfg++) {
+    const ChiBuildConfig& config = config_[iCfg];
+    for (size_t iDM = 0; iDM < evt.Reco_DiMuon_Mom.size(); iDM++) {
+      const TLorentzVector& pDM = evt.Reco_DiMuon_Mom[iDM];
+      const double mDM = pDM.M();
+      if (mDM < config.diMuonMassMin || mDM > config.diMuonMassMax) continue;
+      const double px = pDM.Px(), py = pDM.Py(), pz = pDM.Pz();
+      double e = pDM.E(), offset = 0.;
+      if (config.constraint == kMassConstraint) { e = std::sqrt(px*px + py*py + pz*pz + config.diMuonMassPDG*config.diMuonMassPDG); }
+      if (config.constraint == kDeltaMass     ) { offset = config.diMuonMassPDG - mDM; }
+      // The last pooled events first
+      for (UInt_t k = 1; k <= std::min(mixing_.depth, pool.size); k++) {
+        const UInt_t slot = (pool.next + mixing_.capacity - k) % mixing_.capacity;
+        const size_t c0 = size_t(slot)*maxConv;
+        for (UInt_t iC = 0; iC < pool.nConv[slot]; iC++) {
+          const double sx = px + pool.px[c0+iC], sy = py + pool.py[c0+iC], sz = pz + pool.pz[c0+iC], se = e + pool.e[c0+iC];
+          const double m2 = se*se - sx*sx - sy*sy - sz*sz;
+          const double m = std::sqrt(m2 > 0. ? m2 : 0.) + offset;
+          if (m < config.chiMassMin || m > config.chiMassMax) continue;
+          candidates_[iCfg].push_back({ Float_t(m), UShort_t(iDM), UShort_t(0xFFFF), config.type });
+        }
+      }
+    }
+  }
+  if (builder.GetNConv() > 0) Add(pool, builder);
+}
+
+void ChiEventMixer::Add(MixingPool& pool, ChiCandidateBuilder& builder)
+{
+  const UInt_t maxConv = mixing_.maxConv;
+  if (maxConv==0) return;
+  if (pool.nConv.empty()) {
+    const size_t n = size_t(mixing_.capacity)*maxConv;
+    pool.px.resize(n); pool.py.resize(n); pool.pz.resize(n); pool.e.resize(n);
+    pool.nConv.assign(mixing_.capacity, 0);
+  }
+  // Replace the oldest event, only the first maxConv conversions are kept
+  const UInt_t slot = pool.next;
+  const size_t c0 = size_t(slot)*maxConv;
+  const UInt_t n = std::min(UInt_t(builder.GetNConv()), maxConv);
+  for (UInt_t iC = 0; iC < n; iC++) {
+    const TLorentzVector p = builder.ConvMom(iC);
+    pool.px[c0+iC] = p.Px(); pool.py[c0+iC] = p.Py(); pool.pz[c0+iC] = p.Pz(); pool.e[c0+iC] = p.E();
+  }
+  pool.nConv[slot] = n;
+  pool.next = (slot + 1) % mixing_.capacity;
+  pool.size = std::min(pool.size + 1, mixing_.capacity);
+}
+
+#endif
@@ -0,0 +1,438 @@
+#ifndef ChiMassFitter_h
+#define ChiMassFitter_h
+
+// Header file for ROOT classes
+#include <Rtypes.h>
+#include <Math/IFunction.h>
+#include <Math/Minimizer.h>
+#include <Math/Factory.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cmath>
+#include <algorithm>
+
+
+// Gaussian peak at the PDG mass shifted by the common mass scale, with width sigma*widthScale
+typedef struct ChiPeak {
+  std::string   name;
+  double        mass;
+  double        widthScale;
+} ChiPeak;
+
+typedef struct FitParameter {
+  std::string   name;
+  double        value;
+  double        error;
+  double        min;
+  double        max;
+  bool          fixed;
+} FitParameter;
+
+
+// Threads evaluating the chunks of the likelihood, started once per fit and kept waiting
+// between the evaluations. The calling thread also takes chunks until all of them are done.
+class ChiMassWorkers {
+
+ public :
+
+  ChiMassWorkers(const UInt_t nThreads);
+  virtual ~ChiMassWorkers();
+
+  virtual void               Run        (const size_t nTask, const std::function<void(size_t)>&);
+
+ private:
+
+  virtual void               Loop       (void);
+
+  std::vector<std::thread>                  threads_;
+  std::mutex                                mutex_;
+  std::condition_variable                   start_;
+  std::condition_variable                   done_;
+  const std::function<void(size_t)>*        task_;
+  size_t                                    nTask_;
+  size_t                                    nextTask_;
+  size_t                                    nDone_;
+  UInt_t                                    generation_;
+  bool                                      stop_;
+};
+
+ChiMassWorkers::ChiMassWorkers(const UInt_t nThreads) :
+  task_(0), nTask_(0), nextTask_(0), nDone_(0), generation_(0), stop_(false)
+{
+  for (UInt_t i = 0; i < nThreads; i++) { threads_.push_back(std::thread(&ChiMassWorkers::Loop, this)); }
+}
+
+ChiMassWorkers::~ChiMassWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto& thread : threads_) { thread.join(); }
+}
+
+void ChiMassWorkers::Run(const size_t nTask, const std::function<void(size_t)>& task)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  task_ = &task; nTask_ = nTask; nextTask_ = 0; nDone_ = 0;
+  generation_++;
+  start_.notify_all();
+  while (nextTask_ < nTask_) {
+    const size_t i = nextTask_++;
+    lock.unlock(); task(i); lock.lock();
+    nDone_++;
+  }
+  done_.wait(lock, [this]() { return nDone_==nTask_; });
+  task_ = 0;
+}
+
+void ChiMassWorkers::Loop(void)
+{
+  UInt_t seen = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    start_.wait(lock, [&]() { return stop_ || generation_!=seen; });
+    if (stop_) return;
+    seen = generation_;
+    while (task_ && nextTask_ < nTask_) {
+      const size_t i = nextTask_++;
+      const std::function<void(size_t)>& task = *task_;
+      lock.unlock(); task(i); lock.lock();
+      if (++nDone_==nTask_) done_.notify_all();
+    }
+  }
+}
+
+
+// Extended unbinned negative log-likelihood of the chi mass spectrum:
+// sum of Gaussian peaks plus an exponential background, normalized in the fit range.
+// Parameters: [ N_peak0 ... N_peakN , N_bkg , shift , sigma , lambda ]
+class ChiMassNLL : public ROOT::Math::IMultiGradFunction {
+
+ public :
+
+  ChiMassNLL(const std::vector<ChiPeak>&, const double, const double, const UInt_t nThreads=0);
+  virtual ~ChiMassNLL() {};
+
+  virtual void                              SetData    (const std::vector<double>*);
+  // The worker threads are shared with the clones made by the minimizer
+  virtual void                              StartWorkers (void);
+  virtual void                              StopWorkers  (void) { workers_.reset(); }
+  virtual double                            Density    (const double*, const double) const;
+  virtual size_t                            GetNPeaks  (void) const { return peaks_.size(); }
+  virtual size_t                            GetNData   (void) const { return (data_ ? data_->size() : 0); }
+
+  // IMultiGradFunction interface
+  virtual unsigned int                      NDim       (void) const override { return peaks_.size() + 4; }
+  virtual ROOT::Math::IMultiGenFunction*    Clone      (void) const override { ChiMassNLL* f = new ChiMassNLL(peaks_, xMin_, xMax_, nThreads_); f->SetData(data_); f->workers_ = workers_; return f; }
+  virtual void                              Gradient   (const double* p, double* grad) const override { double f; FdF(p, f, grad); }
+  virtual void                              FdF        (const double*, double&, double*) const override;
+
+  enum { kMaxPeaks = 8, kBlock = 512 };
+
+ private:
+
+  virtual double                            DoEval       (const double* p) const override { return Evaluate(p, 0); }
+  virtual double                            DoDerivative (const double* p, unsigned int i) const override { std::vector<double> g(NDim()); double f; FdF(p, f, g.data()); return g[i]; }
+  virtual double                            Evaluate     (const double*, double*) const;
+  virtual void                              EvaluateChunk(const double*, const size_t, const size_t, double&, double*) const;
+
+  std::vector<ChiPeak>       peaks_;
+  double                     xMin_;
+  double                     xMax_;
+  UInt_t                     nThreads_;
+  const std::vector<double>* data_;
+  std::shared_ptr<ChiMassWorkers> workers_;
+};
+
+ChiMassNLL::ChiMassNLL(const std::vector<ChiPeak>& peaks, const double xMin, const double xMax, const UInt_t nThreads) :
+  peaks_(peaks), xMin_(xMin), xMax_(xMax), nThreads_(nThreads), data_(0)
+{
+  if (peaks_.size() > kMaxPeaks) { std::cout << "[ERROR] Only " << kMaxPeaks << " peaks are supported!" << std::endl; peaks_.resize(kMaxPeaks); }
+  if (nThreads_==0) nThreads_ = std::max(1U, std::thread::hardware_concurrency());
+}
+
+void ChiMassNLL::SetData(const std::vector<double>* data)
+{
+  data_ = data;
+}
+
+void ChiMassNLL::StartWorkers(void)
+{
+  // The calling thread evaluates one of the chunks
+  if (!workers_ && nThreads_ > 1) workers_ = std::make_shared<ChiMassWorkers>(nThreads_ - 1);
+}
+
+void ChiMassNLL::FdF(const double* p, double& f, double* grad) const
+{
+  f = Evaluate(p, grad);
+}
+
+double ChiMassNLL::Evaluate(const double* p, double* grad) const
+{
+  const size_t nPar = NDim();
+  const size_t nData = GetNData();
+  // Split the data in contiguous chunks, one per thread, and sum them in a fixed order. The
+  // chunks only depend on the number of threads, not on whether the workers are running.
+  const size_t nChunk = std::max(size_t(1), std::min(size_t(nThreads_), nData/(4*kBlock)));
+  std::vector<double> sum(nChunk, 0.);
+  std::vector< std::vector<double> > sumGrad(nChunk, std::vector<double>(nPar, 0.));
+  const std::function<void(size_t)> chunk = [&](size_t i) {
+    EvaluateChunk(p, (i*nData)/nChunk, ((i+1)*nData)/nChunk, sum[i], (grad ? sumGrad[i].data() : (double*)0));
+  };
+  if (nChunk > 1 && workers_) { workers_->Run(nChunk, chunk); }
+  else { for (size_t i = 0; i < nChunk; i++) { chunk(i); } }
+  // Extended term: sum of the yields
+  const size_t nYield = peaks_.size() + 1;
+  double nll = 0.;
+  for (size_t k = 0; k < nYield; k++) { nll += p[k]; }
+  for (size_t i = 0; i < nChunk; i++) { nll -= sum[i]; }
+  if (grad) {
+    for (size_t j = 0; j < nPar; j++) {
+      grad[j] = (j < nYield ? 1. : 0.);
+      for (size_t i = 0; i < nChunk; i++) { grad[j] -= sumGrad[i][j]; }
+    }
+  }
+  return nll;
+}
+
+void ChiMassNLL::EvaluateChunk(const double* p, const size_t begin, const size_t end, double& sumLog, double* grad) const
+{
+  // Returns sum(log f) and the derivatives of sum(log f) for the events in [begin, end)
+  const size_t nPeak = peaks_.size();
+  const double nBkg = p[nPeak], shift = p[nPeak+1], sigma = p[nPeak+2], lambda = p[nPeak+3];
+  const double W = xMax_ - xMin_;
+  const double kInvSqrt2Pi = 0.398942280401432678, kInvSqrt2 = 0.707106781186547524;
+  // Per-peak constants: normalization in the fit range and its derivatives
+  std::array<double, kMaxPeaks> mu, sig, norm, dLnCdMu, dLnCdSig;
+  for (size_t k = 0; k < nPeak; k++) {
+    mu[k]  = peaks_[k].mass + shift;
+    sig[k] = std::max(sigma*peaks_[k].widthScale, 1E-9);
+    const double zLo = (xMin_ - mu[k])/sig[k], zHi = (xMax_ - mu[k])/sig[k];
+    const double phiLo = kInvSqrt2Pi*std::exp(-0.5*zLo*zLo), phiHi = kInvSqrt2Pi*std::exp(-0.5*zHi*zHi);
+    const double C = std::max(0.5*(std::erf(zHi*kInvSqrt2) - std::erf(zLo*kInvSqrt2)), 1E-300);
+    norm[k]     = kInvSqrt2Pi/(sig[k]*C);
+    dLnCdMu[k]  = (phiLo - phiHi)/(sig[k]*C);
+    dLnCdSig[k] = (zLo*phiLo - zHi*phiHi)/(sig[k]*C);
+  }
+  // Background: lambda*exp(lambda*(x-xMin))/(exp(lambda*W)-1), flat in the limit lambda -> 0
+  double bNorm = 1./W, dLnBdLambda = -0.5*W;
+  if (std::abs(lambda*W) > 1E-8) {
+    bNorm = lambda/std::expm1(lambda*W);
+    dLnBdLambda = 1./lambda - W/(-std::expm1(-lambda*W));
+  }
+  // Process the events in blocks, each kernel loop runs over contiguous arrays
+  const double* x = data_->data();
+  std::array< std::array<double, kBlock>, kMaxPeaks > g;
+  std::array<double, kBlock> b, f, dx;
+  double sLog = 0., sBkg = 0., sLambda = 0., sShift = 0., sSigma = 0.;
+  std::array<double, kMaxPeaks> sPeak; sPeak.fill(0.);
+  for (size_t start = begin; start < end; start += kBlock) {
+    const size_t n = std::min(size_t(kBlock), end - start);
+    const double* xb = x + start;
+    for (size_t i = 0; i < n; i++) {
+      dx[i] = xb[i] - xMin_;
+      b[i]  = bNorm*std::exp(lambda*dx[i]);
+      f[i]  = nBkg*b[i];
+    }
+    for (size_t k = 0; k < nPeak; k++) {
+      const double m = mu[k], is = 1./sig[k], nk = norm[k], yk = p[k];
+      double* gk = g[k].data();
+      for (size_t i = 0; i < n; i++) {
+        const double z = (xb[i] - m)*is;
+        gk[i] = nk*std::exp(-0.5*z*z);
+        f[i] += yk*gk[i];
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      f[i]  = (f[i] > 1E-300 ? f[i] : 1E-300);
+      sLog += std::log(f[i]);
+      f[i]  = 1./f[i];
+    }
+    if (!grad) continue;
+    for (size_t i = 0; i < n; i++) {
+      const double r = b[i]*f[i];
+      sBkg    += r;
+      sLambda += r*(dLnBdLambda + dx[i]);
+    }
+    for (size_t k = 0; k < nPeak; k++) {
+      const double m = mu[k], is = 1./sig[k], yk = p[k], scale = peaks_[k].widthScale;
+      const double* gk = g[k].data();
+      double s = 0., sMu = 0., sSig = 0.;
+      for (size_t i = 0; i < n; i++) {
+        const double z = (xb[i] - m)*is, r = gk[i]*f[i];
+        s    += r;
+        sMu  += r*(z*is - dLnCdMu[k]);
+        sSig += r*((z*z - 1.)*is - dLnCdSig[k]);
+      }
+      sPeak[k] += s;
+      sShift   += yk*sMu;
+      sSigma   += yk*sSig*scale;
+    }
+  }
+  sumLog = sLog;
+  if (grad) {
+    for (size_t k = 0; k < nPeak; k++) { grad[k] = sPeak[k]; }
+    grad[nPeak]   = sBkg;
+    grad[nPeak+1] = sShift;
+    grad[nPeak+2] = sSigma;
+    grad[nPeak+3] = nBkg*sLambda;
+  }
+}
+
+double ChiMassNLL::Density(const double* p, const double x) const
+{
+  // Fitted spectrum in candidates per unit of mass
+  const size_t nPeak = peaks_.size();
+  const double shift = p[nPeak+1], sigma = p[nPeak+2], lambda = p[nPeak+3], W = xMax_ - xMin_;
+  const double kInvSqrt2Pi = 0.398942280401432678, kInvSqrt2 = 0.707106781186547524;
+  double f = p[nPeak]*(std::abs(lambda*W) > 1E-8 ? lambda*std::exp(lambda*(x - xMin_))/std::expm1(lambda*W) : 1./W);
+  for (size_t k = 0; k < nPeak; k++) {
+    const double mu = peaks_[k].mass + shift, sig = std::max(sigma*peaks_[k].widthScale, 1E-9), z = (x - mu)/sig;
+    const double C = 0.5*(std::erf((xMax_ - mu)/sig*kInvSqrt2) - std::erf((xMin_ - mu)/sig*kInvSqrt2));
+    f += p[k]*kInvSqrt2Pi*std::exp(-0.5*z*z)/(sig*std::max(C, 1E-300));
+  }
+  return f;
+}
+
+
+class ChiMassFitter {
+
+ public :
+
+  ChiMassFitter(const std::vector<ChiPeak>&, const double xMin, const double xMax, const UInt_t nThreads=0);
+  virtual ~ChiMassFitter() {};
+
+  static std::vector<ChiPeak>  ChiCPeaks (void);
+  static std::vector<ChiPeak>  ChiBPeaks (void);
+  static Bool_t                FitMasses (const std::string& label, const std::string& var, const std::vector<double>&,
+                                          const double xMin, const double xMax, const UInt_t nThreads=0);
+
+  virtual Bool_t               Fit       (const std::vector<double>&);
+  virtual void                 Print     (const std::string& label="") const;
+  virtual double               Density   (const double x) const { return nll_.Density(Values().data(), x); }
+  virtual FitParameter&        Parameter (const std::string&);
+  virtual std::vector<double>  Values    (void) const;
+  virtual double               MinNLL    (void) const { return minNLL_; }
+  virtual int                  Status    (void) const { return status_; }
+
+ private:
+
+  ChiMassNLL                   nll_;
+  double                       xMin_;
+  double                       xMax_;
+  std::vector<FitParameter>    par_;
+  std::vector<double>          data_;
+  double                       minNLL_;
+  int                          status_;
+};
+
+ChiMassFitter::ChiMassFitter(const std::vector<ChiPeak>& peaks, const double xMin, const double xMax, const UInt_t nThreads) :
+  nll_(peaks, xMin, xMax, nThreads), xMin_(xMin), xMax_(xMax), minNLL_(0.), status_(-1)
+{
+  for (size_t k = 0; k < nll_.GetNPeaks(); k++) { par_.push_back({ "N_"+peaks[k].name , 0. , 0. , 0. , 1E12 , false }); }
+  par_.push_back({ "N_Bkg"  , 0.               , 0. , 0.                   , 1E12              , false });
+  par_.push_back({ "Shift"  , 0.               , 0. , -0.05*(xMax-xMin)    , 0.05*(xMax-xMin)  , false });
+  par_.push_back({ "Sigma"  , 0.01*(xMax-xMin) , 0. , 0.0005*(xMax-xMin)   , 0.1*(xMax-xMin)   , false });
+  par_.push_back({ "Lambda" , 0.               , 0. , -100./(xMax-xMin)    , 100./(xMax-xMin)  , false });
+}
+
+std::vector<ChiPeak> ChiMassFitter::ChiCPeaks(void)
+{
+  return { { "ChiC1" , 3.51067 , 1. } , { "ChiC2" , 3.55617 , 1. } };
+}
+
+std::vector<ChiPeak> ChiMassFitter::ChiBPeaks(void)
+{
+  // The resolution scales roughly with the photon energy in the Upsilon(1S) rest frame
+  return { { "ChiB1_1P" , 9.89278 , 1. } , { "ChiB2_1P" , 9.91221 , 1.04 } ,
+           { "ChiB1_2P" , 10.25546 , 1.84 } , { "ChiB2_2P" , 10.26865 , 1.87 } };
+}
+
+Bool_t ChiMassFitter::FitMasses(const std::string& label, const std::string& var, const std::vector<double>& mass,
+                                const double xMin, const double xMax, const UInt_t nThreads)
+{
+  // Fit of the chi_c (ChiC_M) or chi_b (ChiB_M) masses kept for one histogram type
+  if (mass.size() < 100) return false;
+  ChiMassFitter fitter((var=="ChiC_M" ? ChiCPeaks() : ChiBPeaks()), xMin, xMax, nThreads);
+  const Bool_t ok = fitter.Fit(mass);
+  fitter.Print(label + " " + var);
+  return ok;
+}
+
+FitParameter& ChiMassFitter::Parameter(const std::string& name)
+{
+  for (auto& par : par_) { if (par.name==name) return par; }
+  std::cout << "[ERROR] Fit parameter " << name << " not found!" << std::endl;
+  return par_.back();
+}
+
+std::vector<double> ChiMassFitter::Values(void) const
+{
+  std::vector<double> values;
+  for (auto& par : par_) { values.push_back(par.value); }
+  return values;
+}
+
+Bool_t ChiMassFitter::Fit(const std::vector<double>& data)
+{
+  // Only keep the candidates inside the fit range
+  const size_t nPeak = nll_.GetNPeaks();
+  data_.clear();
+  for (auto& x : data) { if (x >= xMin_ && x <= xMax_) data_.push_back(x); }
+  nll_.SetData(&data_);
+  if (data_.size()==0) { std::cout << "[ERROR] No candidates to fit!" << std::endl; return false; }
+  // Initial yields, unless set by the user
+  bool init = true;
+  for (size_t k = 0; k <= nPeak; k++) { if (par_[k].value > 0.) init = false; }
+  if (init) {
+    for (size_t k = 0; k < nPeak; k++) { par_[k].value = 0.5*data_.size()/nPeak; }
+    par_[nPeak].value = 0.5*data_.size();
+  }
+  for (size_t k = 0; k <= nPeak; k++) { par_[k].max = 10.*data_.size(); }
+  // Minimize with the analytical gradient
+  std::unique_ptr<ROOT::Math::Minimizer> minimizer(ROOT::Math::Factory::CreateMinimizer("Minuit2", "Migrad"));
+  if (!minimizer) { std::cout << "[ERROR] Minuit2 is not available!" << std::endl; return false; }
+  minimizer->SetFunction(nll_);
+  minimizer->SetErrorDef(0.5);
+  minimizer->SetStrategy(1);
+  minimizer->SetMaxFunctionCalls(100000);
+  minimizer->SetPrintLevel(0);
+  for (size_t i = 0; i < par_.size(); i++) {
+    const double step = std::max(0.1*std::abs(par_[i].value), 0.01*(par_[i].max - par_[i].min)/100.);
+    if (par_[i].fixed) minimizer->SetFixedVariable(i, par_[i].name, par_[i].value);
+    else minimizer->SetLimitedVariable(i, par_[i].name, par_[i].value, step, par_[i].min, par_[i].max);
+  }
+  nll_.StartWorkers();
+  const bool ok = minimizer->Minimize();
+  minimizer->Hesse();
+  nll_.StopWorkers();
+  status_ = minimizer->Status();
+  minNLL_ = minimizer->MinValue();
+  for (size_t i = 0; i < par_.size(); i++) {
+    par_[i].value = minimizer->X()[i];
+    par_[i].error = (minimizer->Errors() ? minimizer->Errors()[i] : 0.);
+  }
+  return ok;
+}
+
+void ChiMassFitter::Print(const std::string& label) const
+{
+  std::cout << "[INFO] Unbinned fit " << label << " of " << data_.size() << " candidates: status " << status_ << " , -log(L) = " << std::setprecision(10) << minNLL_ << std::setprecision(6) << std::endl;
+  for (auto& par : par_) {
+    std::cout << "[INFO]   " << std::left << std::setw(10) << par.name << std::right << " = " << par.value << " +/- " << par.error << (par.fixed ? " (fixed)" : "") << std::endl;
+  }
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef ChiTruthMatcher_h
+#define ChiTruthMatcher_h
+
+// Header file for ROOT classes
+#include <TLorentzVector.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+// Header file for the decoded events
+#include "ChiEvent.h"
+
+
+// Truth matching of the chi candidates of MC samples, done for a whole ChiEventBlock at once.
+// The true decays are the chi particles with a J/psi daughter. A reco muon is traced to its
+// gen muon (Reco_Muon_Gen_Idx, Gen_Muon_Particle_Idx) and up the mothers of its gen particle,
+// through the radiating copies of the muon and of the J/psi, to the chi. A candidate is matched
+// when both muons of its dimuon come from the same true decay. The forest has no gen link for
+// the conversions, so the photon is not matched.
+class ChiTruthMatcher {
+
+ public :
+
+  ChiTruthMatcher(const std::vector<int>& chiPdgId = { 20443 , 445 }, const int diMuonPdgId = 443) : chiPdgId_(chiPdgId), diMuonPdgId_(diMuonPdgId) {};
+  virtual ~ChiTruthMatcher() {};
+
+  virtual Bool_t                 Match         (const ChiEventBlock&);
+
+  // True decays of the last block, those of event i are in [TrueOffset(i), TrueOffset(i+1))
+  virtual UInt_t                 TrueOffset    (const size_t iEvt) const { return trueOffset_[iEvt]; }
+  virtual int                    TruePdgId     (const UInt_t iTrue) const { return truePdgId_[iTrue]; }
+  virtual const TLorentzVector&  TrueMom       (const UInt_t iTrue) const { return *trueMom_[iTrue]; }
+  // True decay of a candidate of the last block (index in the block columns), -1 if not matched
+  virtual int                    CandidateTrue (const UInt_t iCand) const { return candTrue_[iCand]; }
+
+ private:
+
+  virtual bool                   IsChi         (const int pdgId) const;
+  virtual int                    MuonTrue      (const ChiEventBlock&, const size_t iEvt, const UInt_t iMuon) const;
+
+  std::vector<int>                      chiPdgId_;
+  int                                   diMuonPdgId_;
+
+  // TRUE DECAYS (one entry per chi particle of the block)
+  std::vector<UInt_t>                   trueOffset_;
+  std::vector<int>                      truePdgId_;
+  std::vector<const TLorentzVector*>    trueMom_;
+  // TRUE DECAY OF EACH GEN PARTICLE, MUON, DIMUON AND CANDIDATE OF THE BLOCK (-1 if none)
+  std::vector<int>                      genTrue_;
+  std::vector<int>                      muonTrue_;
+  std::vector<int>                      diMuonTrue_;
+  std::vector<int>                      candTrue_;
+};
+
+Bool_t ChiTruthMatcher::Match(const ChiEventBlock& block)
+{
+  const size_t nEvt = block.Size();
+  trueOffset_.assign(1, 0);
+  truePdgId_.clear();
+  trueMom_.clear();
+  genTrue_.assign(block.Gen_Particle_PdgId.size(), -1);
+  muonTrue_.assign(block.Reco_Muon_Mom.size(), -1);
+  diMuonTrue_.assign(block.Reco_DiMuon_Mom.size(), -1);
+  candTrue_.assign(block.Reco_Chi_Type.size(), -1);
+  if (block.Gen_Offset.size()!=nEvt+1 || block.GenMuon_Offset.size()!=nEvt+1 || block.Reco_Muon_Gen_Idx.size()!=block.Reco_Muon_Mom.size()) {
+    std::cout << "[ERROR] The gen columns of the block were not read!" << std::endl; return false;
+  }
+  for (size_t iEvt = 0; iEvt < nEvt; iEvt++) {
+    // The mother indices count from the first gen particle of the event
+    const UInt_t g0 = block.Gen_Offset[iEvt], nG = block.Gen_Offset[iEvt+1] - g0;
+    for (UInt_t iG = g0; iG < g0 + nG; iG++) {
+      if (std::abs(block.Gen_Particle_PdgId[iG])!=diMuonPdgId_) continue;
+      const UShort_t mother = block.Gen_Particle_Mother_Idx[iG];
+      if (mother >= nG || !IsChi(block.Gen_Particle_PdgId[g0 + mother]) || genTrue_[g0 + mother] >= 0) continue;
+      genTrue_[g0 + mother] = truePdgId_.size();
+      truePdgId_.push_back(block.Gen_Particle_PdgId[g0 + mother]);
+      trueMom_.push_back(&block.Gen_Particle_Mom[g0 + mother]);
+    }
+    trueOffset_.push_back(truePdgId_.size());
+    // The reco muons, and their gen links, are only read for the events with candidates: the
+    // true decays of the other events are kept for the efficiency, but have nothing to match
+    if (trueOffset_[iEvt+1]==trueOffset_[iEvt]) continue;
+    for (UInt_t iM = block.Muon_Offset[iEvt]; iM < block.Muon_Offset[iEvt+1]; iM++) { muonTrue_[iM] = MuonTrue(block, iEvt, iM); }
+    // The muon and dimuon indices count from the first muon and dimuon of the event
+    const UInt_t m0 = block.Muon_Offset[iEvt], nM = block.Muon_Offset[iEvt+1] - m0;
+    const UInt_t d0 = block.DiMuon_Offset[iEvt], nD = block.DiMuon_Offset[iEvt+1] - d0;
+    for (UInt_t iDM = d0; iDM < d0 + nD; iDM++) {
+      const UInt_t iM1 = block.Reco_DiMuon_Muon1_Idx[iDM], iM2 = block.Reco_DiMuon_Muon2_Idx[iDM];
+      if (iM1 >= nM || iM2 >= nM) continue;
+      const int t1 = muonTrue_[m0 + iM1], t2 = muonTrue_[m0 + iM2];
+      diMuonTrue_[iDM] = (t1 >= 0 && t1==t2 ? t1 : -1);
+    }
+    for (UInt_t iC = block.Chi_Offset[iEvt]; iC < block.Chi_Offset[iEvt+1]; iC++) {
+      const UInt_t iDM = block.Reco_DiMuonConv_DiMuon_Idx[iC];
+      if (iDM < nD) candTrue_[iC] = diMuonTrue_[d0 + iDM];
+    }
+  }
+  return true;
+}
+
+bool ChiTruthMatcher::IsChi(const int pdgId) const
+{
+  for (auto& id : chiPdgId_) { if (std::abs(pdgId)==id) return true; }
+  return false;
+}
+
+int ChiTruthMatcher::MuonTrue(const ChiEventBlock& block, const size_t iEvt, const UInt_t iMuon) const
+{
+  const int iGenMuon = (signed char)(block.Reco_Muon_Gen_Idx[iMuon]);
+  const UInt_t gm0 = block.GenMuon_Offset[iEvt], nGM = block.GenMuon_Offset[iEvt+1] - gm0;
+  if (iGenMuon < 0 || UInt_t(iGenMuon) >= nGM) return -1;
+  const UInt_t g0 = block.Gen_Offset[iEvt], nG = block.Gen_Offset[iEvt+1] - g0;
+  UInt_t iG = block.Gen_Muon_Particle_Idx[gm0 + iGenMuon];
+  // Walk up the copies of the muon, then of the J/psi, up to the chi (bounded against loops)
+  for (UInt_t step = 0; step < 32 && iG < nG; step++) {
+    const int pdgId = std::abs(block.Gen_Particle_PdgId[g0 + iG]);
+    const UShort_t mother = block.Gen_Particle_Mother_Idx[g0 + iG];
+    if (mother >= nG) return -1;
+    if (pdgId==diMuonPdgId_ && IsChi(block.Gen_Particle_PdgId[g0 + mother])) return genTrue_[g0 + mother];
+    if (pdgId!=13 && pdgId!=diMuonPdgId_) return -1;
+    const int motherPdgId = std::abs(block.Gen_Particle_PdgId[g0 + mother]);
+    if (pdgId==diMuonPdgId_ && motherPdgId!=diMuonPdgId_) return -1;
+    iG = mother;
+  }
+  return -1;
+}
+
+#endif
@@ -0,0 +1,332 @@
+#ifndef EventPrefetcher_h
+#define EventPrefetcher_h
+
+// Header file for ROOT classes
+#include <TROOT.h>
+#include <TTree.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+
+// Header file for the forest readers
+#include "HiForestTree.h"
+#include "ChiEntryList.h"
+#include "ChiEvent.h"
+
+
+template <typename T>
+class BoundedQueue {
+
+ public :
+
+  BoundedQueue(const size_t capacity) : capacity_(capacity>0 ? capacity : 1), closed_(false) {}
+
+  // Block until there is room in the queue, return false if the queue was closed
+  bool Push(T&& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(lock, [this]{ return (closed_ || queue_.size() < capacity_); });
+    if (closed_) return false;
+    queue_.push_back(std::move(item));
+    notEmpty_.notify_one();
+    return true;
+  }
+  // Block until an item is available, return false once the queue is closed and drained
+  bool Pop(T& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notEmpty_.wait(lock, [this]{ return (closed_ || !queue_.empty()); });
+    if (queue_.empty()) return false;
+    item = std::move(queue_.front());
+    queue_.pop_front();
+    notFull_.notify_one();
+    return true;
+  }
+  // Non-blocking versions, used to recycle the block buffers
+  bool TryPush(T&& item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || queue_.size() >= capacity_) return false;
+    queue_.push_back(std::move(item));
+    notEmpty_.notify_one();
+    return true;
+  }
+  bool TryPop(T& item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.empty()) return false;
+    item = std::move(queue_.front());
+    queue_.pop_front();
+    notFull_.notify_one();
+    return true;
+  }
+  // Wake up all producers and consumers, no more items are accepted
+  void Close(const bool drop=false) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    if (drop) queue_.clear();
+    notFull_.notify_all();
+    notEmpty_.notify_all();
+  }
+
+ private:
+
+  const size_t              capacity_;
+  bool                      closed_;
+  std::deque<T>             queue_;
+  std::mutex                mutex_;
+  std::condition_variable   notFull_;
+  std::condition_variable   notEmpty_;
+};
+
+
+class EventPrefetcher {
+
+ public :
+
+  EventPrefetcher();
+  virtual ~EventPrefetcher();
+
+  virtual Bool_t       Open       (const std::string&, const UInt_t nThreads=1);
+  virtual Bool_t       SetRange   (const Long64_t first, const Long64_t last=-1);
+  virtual Bool_t       SetShard   (const UInt_t shard, const UInt_t nShards);
+  virtual Bool_t       SetEntryList (const std::string& dir, const int chiType=0);
+  virtual Bool_t       SetReadGen (const Bool_t);
+  virtual Bool_t       Start      (const UInt_t depth=16, const UInt_t blockSize=1000, const Bool_t ordered=false);
+  virtual Bool_t       Next       (ChiEventBlock&);
+  virtual void         Stop       (void);
+  virtual Long64_t     GetEntries (void) { return nentries_; }
+  virtual Bool_t       IsGood     (void) { return !error_; }
+  virtual std::string  Error      (void) { std::lock_guard<std::mutex> lock(mutex_); return message_; }
+
+ private:
+
+  virtual void         Process    (const UInt_t);
+  virtual void         SetError   (const std::string&);
+  virtual Bool_t       WaitTurn   (const Long64_t);
+  virtual void         EndTurn    (void);
+
+  std::string                                        fileName_;
+  Long64_t                                           nentries_;
+  UInt_t                                             blockSize_;
+
+  // One forest reader per I/O thread, each with its own file handle
+  std::vector< std::unique_ptr<HiForestTree> >       forestTree_;
+
+  // Entry ranges aligned to the tree clusters, handed out to the I/O threads
+  std::vector< std::pair<Long64_t, Long64_t> >       clusters_;
+  std::vector< std::pair<Long64_t, Long64_t> >       ranges_;
+  std::atomic<size_t>                                nextRange_;
+
+  // Blocks delivered in entry order: each block has a sequence number (from the first block of
+  // its range), and is only pushed after the previous one. Each I/O thread then holds at most
+  // one block waiting for its turn.
+  bool                                               ordered_;
+  std::vector<Long64_t>                              rangeSeq_;
+  Long64_t                                           nextSeq_;
+  bool                                               stopping_;
+  std::mutex                                         orderMutex_;
+  std::condition_variable                            orderCond_;
+
+  // Entries with chi candidates, the only ones read when an entry list is used
+  ChiEntryList                                       entryList_;
+  const std::vector<Long64_t>*                       selected_;
+
+  std::unique_ptr< BoundedQueue<ChiEventBlock> >     ready_;
+  std::unique_ptr< BoundedQueue<ChiEventBlock> >     free_;
+  std::vector< std::thread >                         threads_;
+  std::atomic<UInt_t>                                nRunning_;
+  std::atomic<bool>                                  error_;
+  std::mutex                                         mutex_;
+  std::string                                        message_;
+};
+
+EventPrefetcher::EventPrefetcher() : nentries_(0), blockSize_(1000), nextRange_(0), ordered_(false), nextSeq_(0), stopping_(false), selected_(0), nRunning_(0), error_(false)
+{
+}
+
+EventPrefetcher::~EventPrefetcher()
+{
+  Stop();
+}
+
+Bool_t EventPrefetcher::Open(const std::string& fileName, const UInt_t nThreads)
+{
+  Stop();
+  // ROOT I/O is used from several threads
+  ROOT::EnableThreadSafety();
+  fileName_ = fileName;
+  forestTree_.clear();
+  selected_ = 0;
+  // Open the readers on the calling thread, the I/O threads only read entries
+  for (UInt_t i = 0; i < (nThreads>0 ? nThreads : 1); i++) {
+    forestTree_.push_back(std::unique_ptr<HiForestTree>(new HiForestTree()));
+    if (!forestTree_.back()->GetTree(fileName)) return false;
+  }
+  const Long64_t nentries = forestTree_[0]->GetEntries();
+  // Split the entries following the clusters of the muon tree
+  clusters_.clear();
+  TTree::TClusterIterator clusterIter = forestTree_[0]->Tree()->GetClusterIterator(0);
+  Long64_t start;
+  while ((start = clusterIter()) < nentries) {
+    clusters_.push_back(std::make_pair(start, std::min(clusterIter.GetNextEntry(), nentries)));
+  }
+  ranges_ = clusters_;
+  nentries_ = nentries;
+  return true;
+}
+
+Bool_t EventPrefetcher::SetRange(const Long64_t first, const Long64_t last)
+{
+  // Only read the entries in [first, last), last < 0 means up to the end
+  if (first < 0 || (last >= 0 && last < first)) { std::cout << "[ERROR] Invalid entry range [" << first << ", " << last << ")!" << std::endl; return false; }
+  ranges_.clear();
+  nentries_ = 0;
+  for (auto& cluster : clusters_) {
+    const Long64_t begin = std::max(cluster.first, first);
+    const Long64_t end   = (last < 0 ? cluster.second : std::min(cluster.second, last));
+    if (begin >= end) continue;
+    ranges_.push_back(std::make_pair(begin, end));
+    nentries_ += end - begin;
+  }
+  return true;
+}
+
+Bool_t EventPrefetcher::SetShard(const UInt_t shard, const UInt_t nShards)
+{
+  // Split the file in nShards sets of whole clusters, so that no basket is read by two jobs
+  if (nShards==0 || shard >= nShards) { std::cout << "[ERROR] Invalid shard " << shard << " of " << nShards << "!" << std::endl; return false; }
+  const size_t n = clusters_.size();
+  const size_t iBegin = (shard*n)/nShards, iEnd = ((shard+1)*n)/nShards;
+  if (iBegin >= iEnd) { ranges_.clear(); nentries_ = 0; return true; }
+  return SetRange(clusters_[iBegin].first, clusters_[iEnd-1].second);
+}
+
+Bool_t EventPrefetcher::SetEntryList(const std::string& dir, const int chiType)
+{
+  // Only decode the entries with candidates of the given type (0: any), the other entries are
+  // still passed on with only their event branches, so that the events are counted as before
+  if (forestTree_.size()==0) return false;
+  if (!entryList_.Get(dir, fileName_, *forestTree_[0])) return false;
+  static const std::vector<Long64_t> none;
+  selected_ = (entryList_.Entries(chiType) ? entryList_.Entries(chiType) : &none);
+  std::cout << "[INFO] Reading " << selected_->size() << " entries with chi candidates of type " << chiType << " out of " << forestTree_[0]->GetEntries() << std::endl;
+  return true;
+}
+
+Bool_t EventPrefetcher::SetReadGen(const Bool_t readGen)
+{
+  // The blocks also hold the gen columns of all the entries, the entries outside of the entry
+  // list only read the gen branches
+  if (forestTree_.size()==0) return false;
+  for (auto& forest : forestTree_) { if (!forest->SetReadGen(readGen)) return false; }
+  return true;
+}
+
+Bool_t EventPrefetcher::Start(const UInt_t depth, const UInt_t blockSize, const Bool_t ordered)
+{
+  // With several I/O threads the blocks come in the order they are read, unless ordered is set
+  // (e.g. for the event mixing, whose pools depend on the order of the events)
+  if (forestTree_.size()==0) return false;
+  Stop();
+  blockSize_ = (blockSize>0 ? blockSize : 1);
+  ordered_ = (ordered && forestTree_.size() > 1);
+  rangeSeq_.assign(1, 0);
+  for (auto& range : ranges_) { rangeSeq_.push_back(rangeSeq_.back() + (range.second - range.first + blockSize_ - 1)/blockSize_); }
+  nextSeq_ = 0;
+  stopping_ = false;
+  ready_.reset(new BoundedQueue<ChiEventBlock>(depth));
+  free_.reset(new BoundedQueue<ChiEventBlock>(depth + forestTree_.size()));
+  nextRange_ = 0;
+  error_ = false;
+  message_ = "";
+  nRunning_ = forestTree_.size();
+  for (UInt_t i = 0; i < forestTree_.size(); i++) {
+    threads_.push_back(std::thread(&EventPrefetcher::Process, this, i));
+  }
+  return true;
+}
+
+Bool_t EventPrefetcher::Next(ChiEventBlock& block)
+{
+  if (!ready_) return false;
+  // Give the previous block back to the I/O threads to reuse its buffers
+  if (block.entry.capacity()>0) { free_->TryPush(std::move(block)); block = ChiEventBlock(); }
+  if (error_) return false;
+  return ready_->Pop(block);
+}
+
+void EventPrefetcher::Stop(void)
+{
+  {
+    std::lock_guard<std::mutex> lock(orderMutex_);
+    stopping_ = true;
+  }
+  orderCond_.notify_all();
+  if (ready_) ready_->Close(true);
+  if (free_ ) free_->Close(true);
+  for (auto& thread : threads_) { if (thread.joinable()) thread.join(); }
+  threads_.clear();
+}
+
+void EventPrefetcher::Process(const UInt_t iThread)
+{
+  while (!error_) {
+    const size_t iRange = nextRange_++;
+    if (iRange >= ranges_.size()) break;
+    Long64_t entry = ranges_[iRange].first;
+    const Long64_t end = ranges_[iRange].second;
+    bool stop = false;
+    Long64_t seq = rangeSeq_[iRange];
+    while (!stop && entry < end) {
+      ChiEventBlock block;
+      free_->TryPop(block);
+      const Long64_t n = std::min(Long64_t(blockSize_), end-entry);
+      // GetBlock also cross-checks the event IDs of all the trees for every entry
+      if (!forestTree_[iThread]->GetBlock(entry, n, block, selected_)) { SetError(Form("[ERROR] Failed to read the entries [%lld, %lld)!", entry, entry+n)); stop = true; break; }
+      entry += n;
+      if (ordered_ && !WaitTurn(seq++)) { stop = true; break; }
+      if (!ready_->Push(std::move(block))) stop = true;
+      if (ordered_) EndTurn();
+    }
+    if (stop) break;
+  }
+  // The last I/O thread to finish lets the consumer drain the queue
+  if (--nRunning_ == 0 || error_) ready_->Close(error_);
+}
+
+void EventPrefetcher::SetError(const std::string& message)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_) message_ = message;
+    error_ = true;
+  }
+  // Wake up the threads waiting for the turn of the failed block
+  std::lock_guard<std::mutex> lock(orderMutex_);
+  orderCond_.notify_all();
+}
+
+Bool_t EventPrefetcher::WaitTurn(const Long64_t seq)
+{
+  // Return false if the reading was stopped while waiting
+  std::unique_lock<std::mutex> lock(orderMutex_);
+  orderCond_.wait(lock, [&]{ return (nextSeq_==seq || stopping_ || error_); });
+  return (nextSeq_==seq && !stopping_ && !error_);
+}
+
+void EventPrefetcher::EndTurn(void)
+{
+  {
+    std::lock_guard<std::mutex> lock(orderMutex_);
+    nextSeq_++;
+  }
+  orderCond_.notify_all();
+}
+
+#endif
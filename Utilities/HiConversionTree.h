@@ -11,6 +11,9 @@
 #include <vector>
 #include <map>
 
+// Header file for the local cache of remote inputs
+#include "CachedFile.h"
+
 // Header file for the classes stored in the TTree
 #include "TClonesArray.h"
 #include "TLorentzVector.h"
@@ -30,10 +33,13 @@ class HiConversionTree {
   HiConversionTree();
   virtual ~HiConversionTree();
   virtual Bool_t       GetTree    (const std::string&, TTree* tree = 0);
+  virtual Bool_t       GetTree    (TFile*, TTree* tree = 0);
   virtual Int_t        GetEntry   (Long64_t);
   virtual Long64_t     GetEntries (void) { return fChain_->GetEntries(); }
   virtual TTree*       Tree       (void) { return fChain_; }
   virtual void         Clear      (void);
+  virtual void         SetEntry   (Long64_t entry) { entry_ = entry; Clear(); }
+  virtual Bool_t       ScanEntries(std::map< int , std::vector<Long64_t> >&);
 
   // EVENT INFO VARIABLES
   UInt_t               Event_Run()                        { SetBranch("Event_Run");                        return Event_Run_;                             }
@@ -82,6 +88,7 @@ class HiConversionTree {
   }
 
 
+  TFile*                    fFile_;
   TTree*                    fChain_;
   std::map<string, TTree*>  fChainM_;
   Long64_t                  entry_;
@@ -125,25 +132,31 @@ class HiConversionTree {
   TBranch        *b_Reco_Chi_Type;   //!
 };
 
-HiConversionTree::HiConversionTree() : fChain_(0)
+HiConversionTree::HiConversionTree() : fFile_(0), fChain_(0)
 {
 }
 
 HiConversionTree::~HiConversionTree()
 {
-  if (fChain_ && fChain_->GetCurrentFile()) delete fChain_->GetCurrentFile();
+  if (fFile_) delete fFile_;
 }
 
 Bool_t HiConversionTree::GetTree(const std::string& fileName, TTree* tree)
 {
   // Open the input files
-  TFile *f = TFile::Open(fileName.c_str());
+  TFile *f = TCachedFile::OpenFile(fileName);
+  if (!f || !f->IsOpen()) return false;
+  fFile_ = f;
+  return GetTree(f, tree);
+}
+
+Bool_t HiConversionTree::GetTree(TFile* f, TTree* tree)
+{
+  // The input file is owned by the caller
   if (!f || !f->IsOpen()) return false;
   // Extract the input TTrees
   fChainM_.clear();
-  TDirectory * dir;
-  if (fileName.find("root://")!=std::string::npos) dir = (TDirectory*)f->Get("convAna");
-  else dir = (TDirectory*)f->Get((fileName+":/convAna").c_str());
+  TDirectory * dir = (TDirectory*)f->Get("convAna");
   if (!dir) return false;
   if (dir->GetListOfKeys()->Contains("Conversion_Event")) dir->GetObject("Conversion_Event",fChainM_["Event"]);
   if (dir->GetListOfKeys()->Contains("Conversion_Reco"))  dir->GetObject("Conversion_Reco", fChainM_["Reco"]);
@@ -173,6 +186,27 @@ Int_t HiConversionTree::GetEntry(Long64_t entry)
   return LoadEntry();
 }
 
+Bool_t HiConversionTree::ScanEntries(std::map< int , std::vector<Long64_t> >& entries)
+{
+  // List the entries with chi candidates (type 0: any type), reading only the candidate types
+  entries.clear();
+  if (fChainM_.count("Reco")==0 || GetBranchStatus("Reco_Chi_Type")==-1) { std::cout << "[ERROR] No Reco_Chi_Type branch to scan!" << std::endl; return false; }
+  fChainM_.at("Reco")->SetBranchStatus("Reco_Chi_Type", 1);
+  entries[0].clear();
+  const Long64_t nentries = fChainM_.at("Reco")->GetEntries();
+  for (Long64_t i = 0; i < nentries; i++) {
+    if (b_Reco_Chi_Type->GetEntry(i) < 0) { std::cout << "[ERROR] Failed to scan entry " << i << std::endl; return false; }
+    if (!Reco_Chi_Type_ || Reco_Chi_Type_->empty()) continue;
+    entries[0].push_back(i);
+    for (auto& type : *Reco_Chi_Type_) {
+      std::vector<Long64_t>& list = entries[type];
+      if (list.empty() || list.back()!=i) list.push_back(i);
+    }
+  }
+  Clear();
+  return true;
+}
+
 Long64_t HiConversionTree::LoadTree(Long64_t entry)
 {
 // Set the environment to read one entry
@@ -0,0 +1,259 @@
+#ifndef HiForestTree_h
+#define HiForestTree_h
+
+// Header file for ROOT classes
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TLeaf.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+
+// Header file for the forest readers
+#include "CachedFile.h"
+#include "BulkBranch.h"
+#include "ChiEvent.h"
+#include "HiMuonTree.h"
+#include "HiConversionTree.h"
+#include "HiMETTree.h"
+
+
+class HiForestTree {
+
+ public :
+
+  HiForestTree();
+  virtual ~HiForestTree();
+  virtual Bool_t       GetTree    (const std::string&, const Long64_t cacheSize=-1);
+  virtual Int_t        GetEntry   (Long64_t);
+  virtual Bool_t       GetBlock   (const Long64_t first, const Long64_t n, ChiEventBlock&, const std::vector<Long64_t>* selected=0);
+  virtual Long64_t     GetEntries (void) { return muonTree_.GetEntries(); }
+  virtual TTree*       Tree       (void) { return muonTree_.Tree(); }
+  virtual TFile*       File       (void) { return file_; }
+  virtual Bool_t       SetReadGen (const Bool_t);
+
+  // FOREST READERS
+  HiMuonTree&          Muon()                             { return muonTree_;                                                             }
+  HiConversionTree&    Conv()                             { return convTree_;                                                             }
+  HiMETTree&           MET()                              { return metTree_;                                                              }
+  Bool_t               HasMET()                           { return hasMET_;                                                               }
+  Bool_t               HasGen()                           { return hasGen_;                                                               }
+
+  // EVENT INFO VARIABLES (only read from the muon trees)
+  UInt_t               Event_Run()                        { return muonTree_.Event_Run();                                                 }
+  UShort_t             Event_Lumi()                       { return muonTree_.Event_Lumi();                                                }
+  UInt_t               Event_Bx()                         { return muonTree_.Event_Bx();                                                  }
+  ULong64_t            Event_Orbit()                      { return muonTree_.Event_Orbit();                                               }
+  ULong64_t            Event_Number()                     { return muonTree_.Event_Number();                                              }
+  UChar_t              Event_nPV()                        { return muonTree_.Event_nPV();                                                 }
+  TVector3             Event_PriVtx_Pos()                 { return muonTree_.Event_PriVtx_Pos();                                          }
+  TVector3             Event_PriVtx_Err()                 { return muonTree_.Event_PriVtx_Err();                                          }
+
+ private:
+
+  virtual Bool_t       AddEntry   (const Long64_t, ChiEventBlock&);
+  virtual Bool_t       AddGen     (const Long64_t, ChiEventBlock&);
+  virtual Bool_t       CheckBlock (const ChiEventBlock&);
+
+  TFile*                    file_;
+  HiMuonTree                muonTree_;
+  HiConversionTree          convTree_;
+  HiMETTree                 metTree_;
+  Bool_t                    hasMET_;
+  Bool_t                    hasGen_;
+  Bool_t                    readGen_;
+
+  // EVENT IDS OF THE OTHER TREES, READ IN BULK ONLY TO CROSS-CHECK THE ALIGNMENT OF THE TREES
+  typedef struct EventID {
+    std::string             name;
+    BulkBranch<UInt_t>      run;
+    BulkBranch<ULong64_t>   number;
+    BulkBranch<UInt_t>      number32;   // the MET trees only store the lower 32 bits of the event number
+    bool                    is32;
+  } EventID;
+  std::vector< std::unique_ptr<EventID> > eventID_;
+  std::vector< UInt_t >     run_;
+  std::vector< ULong64_t >  number_;
+  std::vector< UInt_t >     number32_;
+
+  // EVENT BRANCHES READ IN BULK BY GetBlock
+  BulkBranch<UInt_t>        eventRun_;
+  BulkBranch<ULong64_t>     eventNumber_;
+};
+
+HiForestTree::HiForestTree() : file_(0), hasMET_(false), hasGen_(false), readGen_(false)
+{
+}
+
+HiForestTree::~HiForestTree()
+{
+  if (file_) delete file_;
+}
+
+Bool_t HiForestTree::GetTree(const std::string& fileName, const Long64_t cacheSize)
+{
+  // Open the input file only once for all the readers, remote files go through the local cache
+  file_ = TCachedFile::OpenFile(fileName);
+  if (!file_ || !file_->IsOpen()) return false;
+  // The muon trees drive the reading, the other trees are added as friends
+  if (!muonTree_.GetTree(file_)) return false;
+  if (!convTree_.GetTree(file_, muonTree_.Tree())) return false;
+  hasMET_ = (file_->Get("metAna") && metTree_.GetTree(file_, muonTree_.Tree()));
+  // MC forests also have the gen muons and particles, linked to the reco muons
+  hasGen_ = (file_->Get("muonAna/Muon_Gen") && Tree()->GetLeaf("Reco_Muon_Gen_Idx"));
+  readGen_ = false;
+  // Keep the event IDs of the other readers to cross-check the alignment of each block
+  eventID_.clear();
+  for (auto& name : { std::string("convAna/Conversion_Event") , std::string(hasMET_ ? "metAna/MET_Event" : "") }) {
+    TTree* t = 0;
+    if (name!="") file_->GetObject(name.c_str(), t);
+    if (!t) continue;
+    if (t->GetEntries() != GetEntries()) { std::cout << "[ERROR] Inconsistent number of entries in " << name << "!" << std::endl; return false; }
+    std::unique_ptr<EventID> id(new EventID());
+    id->name = name;
+    id->is32 = (name=="metAna/MET_Event");
+    if (!id->run.Init(t, "Event_Run") || !(id->is32 ? id->number32.Init(t, "Event_Number") : id->number.Init(t, "Event_Number"))) return false;
+    eventID_.push_back(std::move(id));
+  }
+  // Share one read cache between all the trees: the branches enabled on first
+  // access, including those of the friend trees, are picked up while learning
+  if (cacheSize!=0) Tree()->SetCacheSize(cacheSize);
+  if (!eventRun_.Init(Tree(), "Event_Run") || !eventNumber_.Init(Tree(), "Event_Number")) return false;
+  return true;
+}
+
+Int_t HiForestTree::GetEntry(Long64_t entry)
+{
+  // Clear the friend readers first, the muon reader then loads all the trees at once
+  convTree_.SetEntry(entry);
+  if (hasMET_) metTree_.SetEntry(entry);
+  return muonTree_.GetEntry(entry);
+}
+
+Bool_t HiForestTree::GetBlock(const Long64_t first, const Long64_t n, ChiEventBlock& block, const std::vector<Long64_t>* selected)
+{
+  // The event branches of all the entries are read in bulk, the candidate branches with
+  // GetEntry only for the selected entries (all if no selection), the others have no candidate.
+  // The gen branches are needed for all the entries, the other entries only read those.
+  block.Clear();
+  block.entry.resize(n);
+  block.Event_Run.resize(n);
+  block.Event_Number.resize(n);
+  block.Event_nPV.assign(n, 0);
+  block.Event_PriVtx_Z.assign(n, 0.);
+  for (Long64_t i = 0; i < n; i++) { block.entry[i] = first + i; }
+  if (!eventRun_.Get(first, n, block.Event_Run.data()) || !eventNumber_.Get(first, n, block.Event_Number.data())) return false;
+  if (!CheckBlock(block)) return false;
+  std::vector<Long64_t>::const_iterator sel;
+  if (selected) sel = std::lower_bound(selected->begin(), selected->end(), first);
+  for (Long64_t entry = first; entry < first + n; entry++) {
+    const bool isSelected = (selected && sel!=selected->end() && *sel==entry);
+    if (isSelected) ++sel;
+    if (!selected || isSelected) {
+      if (!AddEntry(entry, block)) return false;
+    }
+    else if (readGen_) {
+      if (muonTree_.GetGenEntry(entry)<0) { std::cout << "[ERROR] Failed to read the gen particles of entry " << entry << "!" << std::endl; return false; }
+      if (!AddGen(entry, block)) return false;
+    }
+    block.EndEvent();
+  }
+  return true;
+}
+
+Bool_t HiForestTree::AddEntry(const Long64_t entry, ChiEventBlock& block)
+{
+  if (GetEntry(entry)<0) { std::cout << "[ERROR] Failed to read entry " << entry << "!" << std::endl; return false; }
+  if (readGen_ && !AddGen(entry, block)) return false;
+  const std::vector<UChar_t> type = convTree_.Reco_Chi_Type();
+  // Only decode the candidate content of events with chi candidates
+  if (type.empty()) return true;
+  // The events are closed one after the other, this entry is the next one of the block
+  const size_t iEvt = block.Chi_Offset.size() - 1;
+  block.Event_nPV[iEvt]      = muonTree_.Event_nPV();
+  block.Event_PriVtx_Z[iEvt] = muonTree_.Event_PriVtx_Pos().Z();
+  const std::vector<Float_t>   mass     = convTree_.Reco_Chi_Mass();
+  const VTLorentzVector        pairMom  = convTree_.Reco_DiMuonConv_Mom();
+  const std::vector<UShort_t>  convIdx  = convTree_.Reco_DiMuonConv_Conversion_Idx();
+  const std::vector<UShort_t>  dmIdx    = convTree_.Reco_DiMuonConv_DiMuon_Idx();
+  const VTLorentzVector        muonMom  = muonTree_.Reco_Muon_Mom();
+  const VTLorentzVector        diMuMom  = muonTree_.Reco_DiMuon_Mom();
+  const std::vector<char>      diMuChg  = muonTree_.Reco_DiMuon_Charge();
+  const std::vector<UChar_t>   muon1Idx = muonTree_.Reco_DiMuon_Muon1_Idx();
+  const std::vector<UChar_t>   muon2Idx = muonTree_.Reco_DiMuon_Muon2_Idx();
+  // The columns of a collection share the same offsets
+  if (mass.size()!=type.size() || pairMom.size()!=type.size() || convIdx.size()!=type.size() || dmIdx.size()!=type.size() ||
+      muon1Idx.size()!=diMuMom.size() || muon2Idx.size()!=diMuMom.size() || diMuChg.size()!=diMuMom.size()) {
+    std::cout << "[ERROR] Inconsistent number of candidates or dimuons in entry " << entry << "!" << std::endl; return false;
+  }
+  block.Reco_Chi_Type.insert(block.Reco_Chi_Type.end(), type.begin(), type.end());
+  block.Reco_Chi_Mass.insert(block.Reco_Chi_Mass.end(), mass.begin(), mass.end());
+  block.Reco_DiMuonConv_Mom.insert(block.Reco_DiMuonConv_Mom.end(), pairMom.begin(), pairMom.end());
+  block.Reco_DiMuonConv_Conversion_Idx.insert(block.Reco_DiMuonConv_Conversion_Idx.end(), convIdx.begin(), convIdx.end());
+  block.Reco_DiMuonConv_DiMuon_Idx.insert(block.Reco_DiMuonConv_DiMuon_Idx.end(), dmIdx.begin(), dmIdx.end());
+  block.Reco_Muon_Mom.insert(block.Reco_Muon_Mom.end(), muonMom.begin(), muonMom.end());
+  block.Reco_DiMuon_Mom.insert(block.Reco_DiMuon_Mom.end(), diMuMom.begin(), diMuMom.end());
+  block.Reco_DiMuon_Charge.insert(block.Reco_DiMuon_Charge.end(), diMuChg.begin(), diMuChg.end());
+  block.Reco_DiMuon_Muon1_Idx.insert(block.Reco_DiMuon_Muon1_Idx.end(), muon1Idx.begin(), muon1Idx.end());
+  block.Reco_DiMuon_Muon2_Idx.insert(block.Reco_DiMuon_Muon2_Idx.end(), muon2Idx.begin(), muon2Idx.end());
+  if (readGen_) {
+    const std::vector<char> genIdx = muonTree_.Reco_Muon_Gen_Idx();
+    if (genIdx.size()!=muonMom.size()) { std::cout << "[ERROR] Inconsistent number of muon gen links in entry " << entry << "!" << std::endl; return false; }
+    block.Reco_Muon_Gen_Idx.insert(block.Reco_Muon_Gen_Idx.end(), genIdx.begin(), genIdx.end());
+  }
+  return true;
+}
+
+Bool_t HiForestTree::AddGen(const Long64_t entry, ChiEventBlock& block)
+{
+  // The true decays are needed in all the events, also those without candidates
+  const std::vector<UShort_t> particleIdx = muonTree_.Gen_Muon_Particle_Idx();
+  const std::vector<int>      pdgId       = muonTree_.Gen_Particle_PdgId();
+  const UShortVecVec          motherIdx   = muonTree_.Gen_Particle_Mother_Idx();
+  const VTLorentzVector       genMom      = muonTree_.Gen_Particle_Mom();
+  if (motherIdx.size()!=pdgId.size() || genMom.size()!=pdgId.size()) {
+    std::cout << "[ERROR] Inconsistent number of gen particles in entry " << entry << "!" << std::endl; return false;
+  }
+  block.Gen_Muon_Particle_Idx.insert(block.Gen_Muon_Particle_Idx.end(), particleIdx.begin(), particleIdx.end());
+  block.Gen_Particle_PdgId.insert(block.Gen_Particle_PdgId.end(), pdgId.begin(), pdgId.end());
+  for (auto& mothers : motherIdx) { block.Gen_Particle_Mother_Idx.push_back(mothers.empty() ? 0xFFFF : mothers[0]); }
+  block.Gen_Particle_Mom.insert(block.Gen_Particle_Mom.end(), genMom.begin(), genMom.end());
+  return true;
+}
+
+Bool_t HiForestTree::CheckBlock(const ChiEventBlock& block)
+{
+  // Compare the run and event number of every entry of the block in all the trees
+  const Long64_t n = block.entry.size();
+  if (n==0) return true;
+  const Long64_t first = block.entry[0];
+  run_.resize(n);
+  for (auto& id : eventID_) {
+    if (!id->run.Get(first, n, run_.data())) return false;
+    if (id->is32) { number32_.resize(n); if (!id->number32.Get(first, n, number32_.data())) return false; }
+    else          { number_.resize(n);   if (!id->number.Get(first, n, number_.data())) return false; }
+    for (Long64_t i = 0; i < n; i++) {
+      const ULong64_t number = block.Event_Number[i];
+      if (run_[i]==block.Event_Run[i] && (id->is32 ? number32_[i]==UInt_t(number & 0xFFFFFFFF) : number_[i]==number)) continue;
+      std::cout << "[ERROR] Event " << block.Event_Run[i] << ":" << number << " of entry " << first + i << " is "
+                << run_[i] << ":" << (id->is32 ? ULong64_t(number32_[i]) : number_[i]) << " in " << id->name << "!" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+Bool_t HiForestTree::SetReadGen(const Bool_t readGen)
+{
+  // Also decode the gen muons and particles of each entry, for the truth matching of MC samples
+  if (readGen && !hasGen_) { std::cout << "[ERROR] No gen branches in " << (file_ ? file_->GetName() : "the input") << "!" << std::endl; return false; }
+  readGen_ = readGen;
+  return true;
+}
+
+#endif
@@ -10,6 +10,9 @@
 #include <iostream>
 #include <map>
 
+// Header file for the local cache of remote inputs
+#include "CachedFile.h"
+
 // Header file for the classes stored in the TTree
 #include "TVector2.h"
 #include "TMatrixD.h"
@@ -22,10 +25,12 @@ class HiMETTree {
   HiMETTree();
   virtual ~HiMETTree();
   virtual Bool_t       GetTree    (const std::string&, TTree* tree = 0, const std::string& treeName="metAna");
+  virtual Bool_t       GetTree    (TFile*, TTree* tree = 0, const std::string& treeName="metAna");
   virtual Int_t        GetEntry   (Long64_t);
   virtual Long64_t     GetEntries (void) { return fChain_->GetEntries(); }
   virtual TTree*       Tree       (void) { return fChain_; }
   virtual void         Clear      (void);
+  virtual void         SetEntry   (Long64_t entry) { entry_ = entry; Clear(); }
 
 
   // EVENT INFO POINTERS
@@ -263,6 +268,7 @@ class HiMETTree {
   template <typename T>
     T GET(T* x) { return ( (x) ? *x : T() ); }
 
+  TFile*                    fFile_;
   TTree*                    fChain_;
   std::map<string, TTree*>  fChainM_;
   Long64_t                  entry_;
@@ -718,25 +724,31 @@ class HiMETTree {
   TBranch        *b_Flag_trkPOG_toomanystripclus53X;
 };
 
-HiMETTree::HiMETTree() : fChain_(0)
+HiMETTree::HiMETTree() : fFile_(0), fChain_(0)
 {
 }
 
 HiMETTree::~HiMETTree()
 {
-  if (fChain_) fChain_->GetCurrentFile();
+  if (fFile_) delete fFile_;
 }
 
 Bool_t HiMETTree::GetTree(const std::string& fileName, TTree* tree, const std::string& treeName)
 {
   // Open the input files
-  TFile *f = TFile::Open(fileName.c_str());
+  TFile *f = TCachedFile::OpenFile(fileName);
+  if (!f || !f->IsOpen()) return false;
+  fFile_ = f;
+  return GetTree(f, tree, treeName);
+}
+
+Bool_t HiMETTree::GetTree(TFile* f, TTree* tree, const std::string& treeName)
+{
+  // The input file is owned by the caller
   if (!f || !f->IsOpen()) return false;
   // Extract the input TTrees
   fChainM_.clear();
-  TDirectory * dir;
-  if (fileName.find("root://")!=std::string::npos) dir = (TDirectory*)f->Get(treeName.c_str());
-  else dir = (TDirectory*)f->Get((fileName+":/"+treeName).c_str());
+  TDirectory * dir = (TDirectory*)f->Get(treeName.c_str());
   if (!dir) return false;
   if (dir->GetListOfKeys()->Contains("MET_Event")  ) dir->GetObject("MET_Event",  fChainM_["Event"]  );
   if (dir->GetListOfKeys()->Contains("MET_Reco")   ) dir->GetObject("MET_Reco",   fChainM_["Reco"]   );
@@ -12,6 +12,9 @@
 #include <vector>
 #include <map>
 
+// Header file for the local cache of remote inputs
+#include "CachedFile.h"
+
 // Header file for the classes stored in the TTree
 #include "TClonesArray.h"
 #include "TLorentzVector.h"
@@ -31,10 +34,13 @@ public :
   HiMuonTree();
   virtual ~HiMuonTree();
   virtual Bool_t       GetTree    (const std::string&, TTree* tree = 0);
+  virtual Bool_t       GetTree    (TFile*, TTree* tree = 0);
   virtual Int_t        GetEntry   (Long64_t);
+  virtual Int_t        GetGenEntry(Long64_t);
   virtual Long64_t     GetEntries (void) { return fChain_->GetEntries(); }
   virtual TTree*       Tree       (void) { return fChain_; }
   virtual void         Clear      (void);
+  virtual void         SetEntry   (Long64_t entry) { entry_ = entry; Clear(); }
 
   // EVENT INFO VARIABLES
   UInt_t               Event_Run()                        { SetBranch("Event_Run");                        return Event_Run_;                             }
@@ -148,6 +154,12 @@ public :
   std::vector<float>   PF_Candidate_Eta()                 { SetBranch("PF_Candidate_Eta");                 return GET(PF_Candidate_Eta_);                 }
   std::vector<float>   PF_Candidate_Phi()                 { SetBranch("PF_Candidate_Phi");                 return GET(PF_Candidate_Phi_);                 }
   std::vector<float>   PF_Candidate_Pt()                  { SetBranch("PF_Candidate_Pt");                  return GET(PF_Candidate_Pt_);                  }
+  // PF CANDIDATE VARIABLES BY REFERENCE (valid until the next entry, e.g. to fill PFIsolationGrid without copies)
+  const std::vector<bool>&    PF_Candidate_isPU_Ref()     { SetBranch("PF_Candidate_isPU");                return REF(PF_Candidate_isPU_);                }
+  const std::vector<UChar_t>& PF_Candidate_Id_Ref()       { SetBranch("PF_Candidate_Id");                  return REF(PF_Candidate_Id_);                  }
+  const std::vector<float>&   PF_Candidate_Eta_Ref()      { SetBranch("PF_Candidate_Eta");                 return REF(PF_Candidate_Eta_);                 }
+  const std::vector<float>&   PF_Candidate_Phi_Ref()      { SetBranch("PF_Candidate_Phi");                 return REF(PF_Candidate_Phi_);                 }
+  const std::vector<float>&   PF_Candidate_Pt_Ref()       { SetBranch("PF_Candidate_Pt");                  return REF(PF_Candidate_Pt_);                  }
   UChar_t              PF_Muon_N()                        { SetBranch("PF_Muon_N");                        return PF_Muon_N_;                             }
   VTLorentzVector      PF_Muon_Mom()                      { SetBranch("PF_Muon_Mom");                      return EXTRACTLV("PF_Muon_Mom");               }
   std::vector<char>    PF_Muon_Charge()                   { SetBranch("PF_Muon_Charge");                   return GET(PF_Muon_Charge_);                   }
@@ -204,6 +216,9 @@ public :
   template <typename T> 
     T GET(T* x) { return ( (x) ? *x : T() ); }
 
+  template <typename T> 
+    const T& REF(T* x) { static const T empty; return ( (x) ? *x : empty ); }
+
   template <typename T, typename A> 
     void GETV(TClonesArray* c, std::vector<T,A>& v) { v.clear(); if (c) { for (int i=0; i < c->GetEntries(); i++) { v.push_back( *(dynamic_cast<T*>(c->At(i))) ); } } }
 
@@ -223,6 +238,7 @@ public :
   }
 
 
+  TFile*                    fFile_;
   TTree*                    fChain_;
   std::map<string, TTree*>  fChainM_;
   Long64_t                  entry_;
@@ -534,25 +550,31 @@ public :
   TBranch        *b_Gen_Muon_PF_Idx;   //!
 };
 
-HiMuonTree::HiMuonTree() : fChain_(0)
+HiMuonTree::HiMuonTree() : fFile_(0), fChain_(0)
 {
 }
 
 HiMuonTree::~HiMuonTree()
 {
-  if (fChain_ && fChain_->GetCurrentFile()) delete fChain_->GetCurrentFile();
+  if (fFile_) delete fFile_;
 }
 
 Bool_t HiMuonTree::GetTree(const std::string& fileName, TTree* tree)
 {
   // Open the input files
-  TFile *f = TFile::Open(fileName.c_str());
+  TFile *f = TCachedFile::OpenFile(fileName);
+  if (!f || !f->IsOpen()) return false;
+  fFile_ = f;
+  return GetTree(f, tree);
+}
+
+Bool_t HiMuonTree::GetTree(TFile* f, TTree* tree)
+{
+  // The input file is owned by the caller
   if (!f || !f->IsOpen()) return false;
   // Extract the input TTrees
   fChainM_.clear();
-  TDirectory * dir;
-  if (fileName.find("root://")!=std::string::npos) dir = (TDirectory*)f->Get("muonAna");
-  else dir = (TDirectory*)f->Get((fileName+":/muonAna").c_str());
+  TDirectory * dir = (TDirectory*)f->Get("muonAna");
   if (!dir) return false;
   if (dir->GetListOfKeys()->Contains("Muon_Event")) dir->GetObject("Muon_Event",fChainM_["Event"]);
   if (dir->GetListOfKeys()->Contains("Muon_Reco"))  dir->GetObject("Muon_Reco", fChainM_["Reco"]);
@@ -567,7 +589,7 @@ Bool_t HiMuonTree::GetTree(const std::string& fileName, TTree* tree)
   else      { fChain_ = fChainM_.begin()->second; }
   for (auto iter = fChainM_.begin(); iter != fChainM_.end(); iter++) {
     (iter->second)->SetMakeClass(1); // For the proper setup.
-    if (iter->second != fChain_) {
+    if (iter->second != fChain_ && !(fChain_->GetListOfFriends() && fChain_->GetListOfFriends()->FindObject(iter->second->GetName()))) {
       fChain_->AddFriend(iter->second); // Add the Friend TTree
       //(iter->second)->ResetBranchAddresses(); // Reset the branch address of the friend to avoid problems
     }
@@ -585,6 +607,15 @@ Int_t HiMuonTree::GetEntry(Long64_t entry)
   return LoadEntry();
 }
 
+Int_t HiMuonTree::GetGenEntry(Long64_t entry)
+{
+  // Read only the gen branches of the entry, the other variables are empty
+  entry_ = entry;
+  Clear();
+  if (fChainM_.count("Gen")==0 || !fChainM_.at("Gen")) return -1;
+  return fChainM_.at("Gen")->GetEntry(entry_);
+}
+
 Long64_t HiMuonTree::LoadTree(Long64_t entry)
 {
 // Set the environment to read one entry
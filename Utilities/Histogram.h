@@ -7,6 +7,9 @@
 #include <TStyle.h>
 #include <TSystem.h>
 #include <TCanvas.h>
+#include <TDirectory.h>
+#include <TKey.h>
+#include <TNamed.h>
 
 // Header file for c++ classes
 #include <iostream>
@@ -15,6 +18,11 @@
 #include <vector>
 #include <map>
 #include <iterator>
+#include <deque>
+#include <memory>
+
+// Header file for the bin storage
+#include "HistogramStore.h"
 
 // CMS STYLE
 #include "CMS/tdrstyle.C"
@@ -48,12 +56,31 @@ class Histogram {
   Histogram();
   virtual ~Histogram();
   
-  virtual void         Book    ( const std::string&, const std::map< std::string , struct VarInfo >& );
-  virtual void         Fill    ( const std::string&, const std::map< std::string , float >& );
-  virtual void         Draw    ( const std::string& );
-  virtual void         Delete  ( void );
+  virtual void            Book    ( const std::string&, const std::map< std::string , struct VarInfo >&, const bool weighted=false, const bool shared=false );
+  virtual void            Fill    ( const std::string&, const std::map< std::string , float >& );
+  virtual HistogramStore* Handle  ( const std::string&, const std::string& );
+  virtual void            Sync    ( void );
+  virtual void            Draw    ( const std::string& );
+  virtual Bool_t          Write   ( TDirectory*, const std::string& tags="separate" );
+  virtual Bool_t          Read    ( TDirectory* );
+  const std::string&      GetTags ( void ) const { return tags_; }
+  virtual void            Delete  ( void );
+
+  // The event loop fills the stores, the ROOT histograms are only created and updated from
+  // them by Sync, when the histograms are drawn or saved
+  std::map< std::string ,std::map< std::string , TH1D* > > TH1D_;
+  std::map< std::string ,std::map< std::string , HistogramStore* > > store_;
+
+ private:
+
+  virtual HistogramStore* NewStore( const std::string&, const std::string&, const UInt_t, const double, const double, const StoreMode );
 
-  std::map< std::string ,std::map< std::string , TH1F* > > TH1F_;
+  // The bins of all the stores are kept in one arena, the stores only hold the binning
+  HistogramArena                         arena_;
+  std::deque< HistogramStore >           stores_;
+  std::map< std::string , std::string >  label_;
+  // Draw tags stored with the histograms, used when replotting
+  std::string                            tags_;
 
 };
 
@@ -69,30 +96,73 @@ Histogram::~Histogram()
 }
 
 void 
-Histogram::Book(const std::string& type, const std::map< std::string , struct VarInfo >& varMap)
+Histogram::Book(const std::string& type, const std::map< std::string , struct VarInfo >& varMap, const bool weighted, const bool shared)
 {
   for (auto& var : varMap) {
     std::string    varName = var.first;
     struct VarInfo varInfo = var.second;
-    std::string histName = (std::string("h_") + type + "_" + varName);
-    if (TH1F_.count(type)==0 || TH1F_[type].count(varName)==0) {
-      // Create the Histogram
-      TH1F_[type][varName] = new TH1F(histName.c_str(), histName.c_str(), varInfo.nBin, varInfo.min, varInfo.max);
-      // Initialize the Histogram
-      TH1F_[type][varName]->GetYaxis()->SetTitle("Number of Entries");
-      TH1F_[type][varName]->GetXaxis()->SetTitle(varInfo.label.c_str());
-      std::cout << "[INFO] Added histogram: " << histName << std::endl;
+    if (Handle(type, varName)==0) {
+      // Only the binning is booked, the bins are allocated at the first fill (when booked for shared fills)
+      label_[varName] = varInfo.label;
+      NewStore(type, varName, varInfo.nBin, varInfo.min, varInfo.max, (shared ? kShared : (weighted ? kWeighted : kCount)));
+      std::cout << "[INFO] Added histogram: " << (std::string("h_") + type + "_" + varName) << std::endl;
     }
   }
 }
 
+HistogramStore* 
+Histogram::NewStore(const std::string& type, const std::string& varName, const UInt_t nBin, const double min, const double max, const StoreMode mode)
+{
+  stores_.emplace_back(arena_, nBin, min, max, mode);
+  store_[type][varName] = &stores_.back();
+  return store_[type][varName];
+}
+
 void 
 Histogram::Fill(const std::string& type, const std::map< std::string , float >& valueMap)
 {
   for (auto& value : valueMap) {
     std::string varName  = value.first;
-    if (TH1F_.count(type)>0 && TH1F_[type].count(varName)>0 && TH1F_[type][varName]) {
-      TH1F_[type][varName]->Fill(value.second); 
+    HistogramStore* h = Handle(type, varName);
+    if (h) h->Fill(value.second);
+  }
+}
+
+HistogramStore* 
+Histogram::Handle(const std::string& type, const std::string& varName)
+{
+  // Direct access to the store of a booked histogram, null if it was not booked
+  auto t = store_.find(type);
+  if (t==store_.end()) return 0;
+  auto v = t->second.find(varName);
+  return (v==t->second.end() ? 0 : v->second);
+}
+
+void 
+Histogram::Sync(void)
+{
+  for (auto& t : store_) {
+    std::string type = t.first;
+    for (auto& elem : t.second) {
+      std::string varName = elem.first;
+      HistogramStore* store = elem.second;
+      if (!store) continue;
+      // Every booked histogram is created, the bins of a store never filled are exported as zero
+      // without allocating its memory
+      auto t1 = TH1D_.find(type);
+      const bool exists = (t1!=TH1D_.end() && t1->second.count(varName)>0 && t1->second.at(varName));
+      if (!exists) {
+        // Create the Histogram, in double precision since the bins exceed the float precision
+        std::string histName = (std::string("h_") + type + "_" + varName);
+        TH1D_[type][varName] = new TH1D(histName.c_str(), histName.c_str(), store->GetNbins(), store->GetXmin(), store->GetXmax());
+        TH1D_[type][varName]->SetDirectory(0);
+        // Initialize the Histogram
+        TH1D_[type][varName]->GetYaxis()->SetTitle("Number of Entries");
+        TH1D_[type][varName]->GetXaxis()->SetTitle(label_[varName].c_str());
+        // Weighted histograms keep the sum of the squared weights for the errors
+        if (store->Mode()!=kCount) TH1D_[type][varName]->Sumw2();
+      }
+      store->Export(TH1D_[type][varName]);
     }
   }
 }
@@ -101,38 +171,39 @@ void
 Histogram::Draw(const std::string& tag="")
 {
   if (tag=="") return;
+  Sync();
   // set the CMS style
   setTDRStyle();
   gSystem->mkdir("Plots", kTRUE);
   // Apply General Settings to all Histograms
-  for (auto& t : TH1F_) {
+  for (auto& t : TH1D_) {
     std::string type = t.first;
-    for (auto& elem : TH1F_[type]) {
+    for (auto& elem : TH1D_[type]) {
       std::string varName = elem.first;
-      if (TH1F_[type][varName]) {
-        //TH1F_[type][varName]->GetYaxis()->CenterTitle(kTRUE);
-        TH1F_[type][varName]->GetYaxis()->SetTitleOffset(1.5);
-        TH1F_[type][varName]->GetYaxis()->SetTitleSize(0.04);
-        TH1F_[type][varName]->GetYaxis()->SetLabelSize(0.04);
-        //TH1F_[type][varName]->GetXaxis()->CenterTitle(kTRUE);
-        TH1F_[type][varName]->GetXaxis()->SetTitleOffset(1.0);
-        TH1F_[type][varName]->GetXaxis()->SetTitleSize(0.048);
-        TH1F_[type][varName]->GetXaxis()->SetLabelSize(0.04);
-        TH1F_[type][varName]->SetMarkerColor(kBlack);
+      if (TH1D_[type][varName]) {
+        //TH1D_[type][varName]->GetYaxis()->CenterTitle(kTRUE);
+        TH1D_[type][varName]->GetYaxis()->SetTitleOffset(1.5);
+        TH1D_[type][varName]->GetYaxis()->SetTitleSize(0.04);
+        TH1D_[type][varName]->GetYaxis()->SetLabelSize(0.04);
+        //TH1D_[type][varName]->GetXaxis()->CenterTitle(kTRUE);
+        TH1D_[type][varName]->GetXaxis()->SetTitleOffset(1.0);
+        TH1D_[type][varName]->GetXaxis()->SetTitleSize(0.048);
+        TH1D_[type][varName]->GetXaxis()->SetLabelSize(0.04);
+        TH1D_[type][varName]->SetMarkerColor(kBlack);
       }
     }
   }
   // Case: Separate -> Use one canvas for each histogram
   if (tag=="separate") {
-    for (auto& t : TH1F_) {
+    for (auto& t : TH1D_) {
       std::string type = t.first;
-      for (auto& elem : TH1F_[type]) {
+      for (auto& elem : TH1D_[type]) {
         std::string varName = elem.first;
-        if (TH1F_[type][varName]) {
+        if (TH1D_[type][varName]) {
           std::string cName = (std::string("c_") + type + "_" + varName);
           TCanvas* c = new TCanvas(cName.c_str(), cName.c_str(), 1000, 1000);
           c->cd();
-          TH1F_[type][varName]->Draw("p");
+          TH1D_[type][varName]->Draw("p");
           c->Update();
           int option = 111;
           if (type.find("pPb")!=std::string::npos) option = 109;
@@ -157,23 +228,23 @@ Histogram::Draw(const std::string& tag="")
     TLegend *leg = new TLegend(xl1,yl1,xl2,yl2);
     bool firstDraw = true;
     uint i = 0;
-    for (auto& t : TH1F_) {
+    for (auto& t : TH1D_) {
       std::string type = t.first;
-      for (auto& elem : TH1F_[type]) {
+      for (auto& elem : TH1D_[type]) {
         std::string varName = elem.first;
-        if ( TH1F_[type][varName] && (tag=="together" || type.find(tag)!=std::string::npos) ) {
+        if ( TH1D_[type][varName] && (tag=="together" || type.find(tag)!=std::string::npos) ) {
           c->cd();
-          TH1F_[type][varName]->SetMarkerColor(COLOR[i]);
-          TH1F_[type][varName]->SetMarkerStyle(MARKER[i]);
-          if (firstDraw) { TH1F_[type][varName]->Draw("P"); firstDraw = false; }
-          else  TH1F_[type][varName]->Draw("SAMEP");
+          TH1D_[type][varName]->SetMarkerColor(COLOR[i % COLOR.size()]);
+          TH1D_[type][varName]->SetMarkerStyle(MARKER[i % MARKER.size()]);
+          if (firstDraw) { TH1D_[type][varName]->Draw("P"); firstDraw = false; }
+          else  TH1D_[type][varName]->Draw("SAMEP");
           std::string label = type + "_" + varName;
           if (tag!="together") { 
             if (label.find("_"+tag)!=std::string::npos) label.erase(label.find("_"+tag), ("_"+tag).size());
             else if (label.find(tag+"_")!=std::string::npos) label.erase(label.find(tag+"_"), (tag+"_").size());
             else if (label.find(tag)!=std::string::npos) label.erase(label.find(tag), tag.size());
           }
-          leg->AddEntry(TH1F_[type][varName], label.c_str(), "p");
+          leg->AddEntry(TH1D_[type][varName], label.c_str(), "p");
           i++;
         }
       }
@@ -193,10 +264,81 @@ Histogram::Draw(const std::string& tag="")
   }
 }
 
+Bool_t 
+Histogram::Write(TDirectory* dir, const std::string& tags)
+{
+  // One directory per type, the histograms are stored with the variable name as key, and
+  // the draw tags next to them. The axis titles carry the labels of the variables. The exact
+  // sums of each histogram are stored as <var>_Exact, to merge the outputs without rounding.
+  if (!dir) return false;
+  TNamed drawTags("DrawTags", tags.c_str());
+  dir->WriteTObject(&drawTags, "DrawTags", "Overwrite");
+  Sync();
+  for (auto& t : TH1D_) {
+    std::string type = t.first;
+    TDirectory* typeDir = dir->GetDirectory(type.c_str());
+    if (!typeDir) typeDir = dir->mkdir(type.c_str());
+    if (!typeDir) { std::cout << "[ERROR] Failed to create the directory " << type << std::endl; return false; }
+    for (auto& elem : TH1D_[type]) {
+      if (!elem.second) continue;
+      typeDir->WriteTObject(elem.second, elem.first.c_str(), "Overwrite");
+      HistogramStore* store = Handle(type, elem.first);
+      if (!store) continue;
+      std::unique_ptr<TH1D> exact(store->ExportExact(std::string(elem.second->GetName()) + "_Exact"));
+      typeDir->WriteTObject(exact.get(), (elem.first + "_Exact").c_str(), "Overwrite");
+    }
+  }
+  return true;
+}
+
+Bool_t 
+Histogram::Read(TDirectory* dir)
+{
+  // Read back the layout written by Histogram::Write
+  if (!dir) return false;
+  TNamed* tags = 0;
+  dir->GetObject("DrawTags", tags);
+  if (tags) { tags_ = tags->GetTitle(); delete tags; }
+  TIter nextType(dir->GetListOfKeys());
+  while (TKey* typeKey = (TKey*)nextType()) {
+    if (std::string(typeKey->GetClassName())!="TDirectoryFile") continue;
+    std::string type = typeKey->GetName();
+    TDirectory* typeDir = dir->GetDirectory(type.c_str());
+    if (!typeDir) continue;
+    TIter nextVar(typeDir->GetListOfKeys());
+    while (TKey* varKey = (TKey*)nextVar()) {
+      if (std::string(varKey->GetClassName())!="TH1D") continue;
+      std::string varName = varKey->GetName();
+      if (varName.size()>6 && varName.substr(varName.size()-6)=="_Exact") continue;
+      TH1D* h = (TH1D*)varKey->ReadObj();
+      if (!h) { std::cout << "[ERROR] Failed to read histogram " << type << "/" << varName << std::endl; return false; }
+      h->SetDirectory(0);
+      HistogramStore* store = Handle(type, varName);
+      if (!store) {
+        const TAxis* axis = h->GetXaxis();
+        label_[varName] = axis->GetTitle();
+        store = NewStore(type, varName, h->GetNbinsX(), axis->GetXmin(), axis->GetXmax(), (h->GetSumw2N()>0 ? kWeighted : kCount));
+      }
+      // The exact sums are used when available, the histogram itself otherwise
+      TH1D* exact = 0;
+      typeDir->GetObject((varName + "_Exact").c_str(), exact);
+      const Bool_t ok = (exact ? store->ImportExact(exact) : store->Import(h));
+      delete exact;
+      if (!ok) { delete h; return false; }
+      if (TH1D_[type][varName]) { delete h; }
+      else { h->Reset(); TH1D_[type][varName] = h; }
+    }
+  }
+  return true;
+}
+
 void 
 Histogram::Delete(void)
 {
-  for (auto& elem : TH1F_) { for (auto& hist : elem.second) { if (hist.second) delete hist.second; } }
+  for (auto& elem : TH1D_) { for (auto& hist : elem.second) { if (hist.second) delete hist.second; } }
+  TH1D_.clear();
+  store_.clear();
+  stores_.clear();
 }
 
 #endif
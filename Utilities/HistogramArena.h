@@ -0,0 +1,77 @@
+#ifndef HistogramArena_h
+#define HistogramArena_h
+
+// Header file for c++ classes
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+
+// Memory of the bins of all the histograms, handed out in cache-line aligned pieces carved
+// from large chunks. Pieces are never moved or freed individually, so the stores can keep
+// plain pointers to their bins; everything is released with the arena.
+class HistogramArena {
+
+ public :
+
+  HistogramArena(const size_t chunkSize=(1<<20));
+  virtual ~HistogramArena();
+
+  virtual void*        Allocate     (const size_t nByte);
+  size_t               GetNBytes    (void) const { return nBytes_; }
+  size_t               GetNChunks   (void) const { return chunk_.size(); }
+
+ private:
+
+  HistogramArena(const HistogramArena&);
+  HistogramArena& operator=(const HistogramArena&);
+  char*                NewChunk     (const size_t);
+
+  static const size_t  kAlign = 64;
+
+  size_t               chunkSize_;
+  char*                current_;
+  size_t               used_;
+  size_t               nBytes_;
+  std::vector< char* > chunk_;
+  std::mutex           mutex_;
+};
+
+HistogramArena::HistogramArena(const size_t chunkSize) :
+  chunkSize_(chunkSize), current_(0), used_(chunkSize), nBytes_(0)
+{
+}
+
+HistogramArena::~HistogramArena()
+{
+  for (auto& chunk : chunk_) { std::free(chunk); }
+}
+
+void* HistogramArena::Allocate(const size_t nByte)
+{
+  // Zeroed, and rounded up to whole cache lines so that two histograms never share a line
+  const size_t size = ((nByte + kAlign - 1)/kAlign)*kAlign;
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Histograms larger than a chunk get a chunk of their own
+  if (size > chunkSize_) { nBytes_ += size; return NewChunk(size); }
+  if (used_ + size > chunkSize_) { current_ = NewChunk(chunkSize_); used_ = 0; }
+  char* p = current_ + used_;
+  used_ += size;
+  nBytes_ += size;
+  return p;
+}
+
+char* HistogramArena::NewChunk(const size_t size)
+{
+  void* p = 0;
+  if (posix_memalign(&p, kAlign, size)!=0) throw std::bad_alloc();
+  std::memset(p, 0, size);
+  chunk_.push_back(static_cast<char*>(p));
+  return chunk_.back();
+}
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef HistogramMerger_h
+#define HistogramMerger_h
+
+// Header file for ROOT classes
+#include <TROOT.h>
+#include <TFile.h>
+#include <TDirectory.h>
+#include <TKey.h>
+#include <TList.h>
+#include <TH1.h>
+#include <THnBase.h>
+#include <TParameter.h>
+#include <TVectorD.h>
+#include <TSystem.h>
+#include <TRegexp.h>
+#include <Compression.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+
+// Header file for the exact histogram sums
+#include "HistogramStore.h"
+
+
+// Objects of one file (or of a group of merged files), keyed by their path in the file. The
+// lists of values are kept as their pieces in the order of the inputs, and only concatenated
+// once all the inputs are added, so that each value is copied once.
+typedef struct MergeSet {
+  std::map< std::string , std::unique_ptr<TObject> >                 object;
+  std::map< std::string , std::vector< std::unique_ptr<TVectorD> > > piece;
+  void   clear (void)       { object.clear(); piece.clear(); }
+  size_t size  (void) const { return object.size() + piece.size(); }
+} MergeSet;
+
+
+// Merge the outputs written by Histogram::Write and CandidateCounter::Write, or any file
+// made of directories, histograms (TH1, TH2, TH3, THn), TParameter counters and TVectorD
+// lists of values, which are concatenated.
+// The inputs are split in a fixed number of contiguous groups, each merged by one thread
+// reading its files one at a time, and the groups are then added in a fixed-shape
+// pairwise tree. The result does not depend on the number of threads, and the memory
+// only grows with the number of groups, not with the number of inputs. The histograms
+// written with their exact sums (<name>_Exact, see HistogramStore) are set from the merged
+// sums, so they have the same bits whatever the split of the events between the inputs.
+class HistogramMerger {
+
+ public :
+
+  HistogramMerger(const UInt_t nThreads=0, const UInt_t nGroups=64);
+  virtual ~HistogramMerger() {};
+
+  static std::vector<std::string>  ExpandInputs (const std::string&);
+  virtual Bool_t                   Merge        (const std::vector<std::string>&, const std::string&);
+
+ private:
+
+  virtual Bool_t       ReadFile     (const std::string&, MergeSet&);
+  virtual void         ReadDir      (TDirectory*, const std::string&, MergeSet&);
+  virtual Bool_t       Add          (MergeSet&, MergeSet&, const std::string&);
+  virtual Bool_t       AddObject    (TObject*, TObject*, const std::string&, const std::string&);
+  virtual Bool_t       WriteFile    (const std::string&, const MergeSet&);
+  virtual Bool_t       RebuildExact (MergeSet&);
+  virtual void         Concatenate  (MergeSet&);
+  virtual void         SetError     (const std::string&);
+  static Bool_t        SameAxis     (const TAxis*, const TAxis*);
+  static Bool_t        SameBinning  (const TH1*, const TH1*);
+  static Bool_t        SameBinning  (const THnBase*, const THnBase*);
+
+  UInt_t                 nThreads_;
+  UInt_t                 nGroups_;
+  std::atomic<bool>      error_;
+  std::mutex             mutex_;
+  std::string            message_;
+};
+
+HistogramMerger::HistogramMerger(const UInt_t nThreads, const UInt_t nGroups) :
+  nThreads_(nThreads), nGroups_(nGroups>0 ? nGroups : 1), error_(false)
+{
+  if (nThreads_==0) nThreads_ = std::max(1U, std::thread::hardware_concurrency());
+}
+
+std::vector<std::string> HistogramMerger::ExpandInputs(const std::string& input)
+{
+  // Either a text file with one input per line, or a wildcard such as Output/plotChi_*.root
+  std::vector<std::string> files;
+  if (input.size()>4 && input.substr(input.size()-4)==".txt") {
+    std::ifstream list(input.c_str());
+    std::string line;
+    while (std::getline(list, line)) { if (line!="" && line[0]!='#') files.push_back(line); }
+    return files;
+  }
+  const std::string dirName  = (input.rfind('/')!=std::string::npos ? input.substr(0, input.rfind('/')) : ".");
+  const std::string baseName = (input.rfind('/')!=std::string::npos ? input.substr(input.rfind('/')+1) : input);
+  if (baseName.find_first_of("*?[")==std::string::npos) { files.push_back(input); return files; }
+  void* dir = gSystem->OpenDirectory(dirName.c_str());
+  if (!dir) { std::cout << "[ERROR] Failed to open the directory " << dirName << std::endl; return files; }
+  const TRegexp regexp(baseName.c_str(), kTRUE);
+  while (const char* entry = gSystem->GetDirEntry(dir)) {
+    const TString name(entry);
+    Ssiz_t len = 0;
+    if (regexp.Index(name, &len)==0 && len==name.Length()) files.push_back(dirName + "/" + entry);
+  }
+  gSystem->FreeDirectory(dir);
+  // Directory order is arbitrary, sort to always merge in the same order
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+Bool_t HistogramMerger::Merge(const std::vector<std::string>& inputs, const std::string& output)
+{
+  if (inputs.size()==0) { std::cout << "[ERROR] No input files to merge!" << std::endl; return false; }
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  ROOT::EnableThreadSafety();
+  const Bool_t addDirectory = TH1::AddDirectoryStatus();
+  TH1::AddDirectory(kFALSE);
+  error_ = false;
+  message_ = "";
+
+  // Contiguous groups of inputs, the grouping only depends on the number of inputs
+  const size_t nGroup = std::min(size_t(nGroups_), inputs.size());
+  std::vector< MergeSet > group(nGroup);
+  std::atomic<size_t> nextGroup(0);
+  auto mergeGroups = [&]() {
+    size_t iGroup;
+    while (!error_ && (iGroup = nextGroup++) < nGroup) {
+      const size_t begin = (iGroup*inputs.size())/nGroup, end = ((iGroup+1)*inputs.size())/nGroup;
+      for (size_t i = begin; i < end && !error_; i++) {
+        MergeSet set;
+        if (!ReadFile(inputs[i], set)) break;
+        if (!Add(group[iGroup], set, inputs[i])) break;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (UInt_t i = 0; i < std::min(size_t(nThreads_), nGroup); i++) { threads.push_back(std::thread(mergeGroups)); }
+  for (auto& thread : threads) { thread.join(); }
+  threads.clear();
+
+  // Pairwise reduction of the groups: (0+1)+(2+3)+... with the same shape for any number of threads
+  for (size_t step = 1; step < nGroup && !error_; step *= 2) {
+    std::vector< size_t > pairs;
+    for (size_t i = 0; i + step < nGroup; i += 2*step) { pairs.push_back(i); }
+    std::atomic<size_t> nextPair(0);
+    auto reduce = [&]() {
+      size_t iPair;
+      while (!error_ && (iPair = nextPair++) < pairs.size()) {
+        const size_t i = pairs[iPair];
+        Add(group[i], group[i+step], Form("group %zu", i+step));
+        group[i+step].clear();
+      }
+    };
+    for (UInt_t i = 0; i < std::min(size_t(nThreads_), pairs.size()); i++) { threads.push_back(std::thread(reduce)); }
+    for (auto& thread : threads) { thread.join(); }
+    threads.clear();
+  }
+
+  Bool_t ok = !error_;
+  if (!ok) { std::cout << message_ << std::endl; }
+  else { Concatenate(group[0]); ok = (RebuildExact(group[0]) && WriteFile(output, group[0])); }
+  TH1::AddDirectory(addDirectory);
+  if (ok) {
+    const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[INFO] Merged " << inputs.size() << " files (" << group[0].size() << " objects) into " << output << " in " << time << " s" << std::endl;
+  }
+  return ok;
+}
+
+Bool_t HistogramMerger::ReadFile(const std::string& fileName, MergeSet& set)
+{
+  std::unique_ptr<TFile> file(TFile::Open(fileName.c_str(), "READ"));
+  if (!file || !file->IsOpen() || file->IsZombie()) { SetError("[ERROR] Failed to open " + fileName); return false; }
+  ReadDir(file.get(), "", set);
+  file->Close();
+  return true;
+}
+
+void HistogramMerger::ReadDir(TDirectory* dir, const std::string& path, MergeSet& set)
+{
+  std::set<std::string> done;
+  TIter next(dir->GetListOfKeys());
+  while (TKey* key = (TKey*)next()) {
+    // The keys are sorted by cycle, only keep the latest one
+    const std::string name = key->GetName();
+    if (!done.insert(name).second) continue;
+    const std::string keyPath = (path=="" ? name : path + "/" + name);
+    if (std::string(key->GetClassName())=="TDirectoryFile") {
+      TDirectory* subDir = dir->GetDirectory(name.c_str());
+      if (subDir) ReadDir(subDir, keyPath, set);
+      continue;
+    }
+    TObject* obj = key->ReadObj();
+    if (!obj) continue;
+    if (obj->InheritsFrom("TH1")) ((TH1*)obj)->SetDirectory(0);
+    if (obj->InheritsFrom("TVectorT<double>")) { set.piece[keyPath].emplace_back((TVectorD*)obj); continue; }
+    set.object[keyPath].reset(obj);
+  }
+}
+
+Bool_t HistogramMerger::Add(MergeSet& target, MergeSet& source, const std::string& label)
+{
+  for (auto& elem : source.object) {
+    if (!elem.second) continue;
+    if (target.piece.count(elem.first)>0) { SetError("[ERROR] " + elem.first + " is a list of values but a " + elem.second->ClassName() + " in " + label); return false; }
+    auto it = target.object.find(elem.first);
+    if (it==target.object.end() || !it->second) { target.object[elem.first] = std::move(elem.second); continue; }
+    if (!AddObject(it->second.get(), elem.second.get(), elem.first, label)) return false;
+  }
+  // Lists of values (the chi masses of the fits) are concatenated in the order of the inputs
+  for (auto& elem : source.piece) {
+    auto it = target.object.find(elem.first);
+    if (it!=target.object.end() && it->second) { SetError("[ERROR] " + elem.first + " is a " + it->second->ClassName() + " but a list of values in " + label); return false; }
+    auto& pieces = target.piece[elem.first];
+    for (auto& piece : elem.second) { pieces.push_back(std::move(piece)); }
+  }
+  return true;
+}
+
+Bool_t HistogramMerger::AddObject(TObject* target, TObject* source, const std::string& path, const std::string& label)
+{
+  if (std::string(target->ClassName())!=source->ClassName()) {
+    SetError("[ERROR] " + path + " is a " + target->ClassName() + " but a " + source->ClassName() + " in " + label);
+    return false;
+  }
+  if (target->InheritsFrom("TH1")) {
+    if (!SameBinning((TH1*)target, (TH1*)source)) { SetError("[ERROR] Inconsistent binning of " + path + " in " + label); return false; }
+    ((TH1*)target)->Add((TH1*)source);
+    return true;
+  }
+  if (target->InheritsFrom("THnBase")) {
+    if (!SameBinning((THnBase*)target, (THnBase*)source)) { SetError("[ERROR] Inconsistent binning of " + path + " in " + label); return false; }
+    ((THnBase*)target)->Add((THnBase*)source);
+    return true;
+  }
+  // Counters follow their own merge mode ('+' for the candidate counters)
+  TList list;
+  list.Add(source);
+  if (target->InheritsFrom("TParameter<Long64_t>")) { ((TParameter<Long64_t>*)target)->Merge(&list); return true; }
+  if (target->InheritsFrom("TParameter<double>"  )) { ((TParameter<double>*  )target)->Merge(&list); return true; }
+  // Other objects (e.g. metadata) are taken from the first input
+  return true;
+}
+
+void HistogramMerger::Concatenate(MergeSet& set)
+{
+  // Each list is allocated once with its final size
+  for (auto& elem : set.piece) {
+    Int_t n = 0;
+    for (auto& piece : elem.second) { n += piece->GetNrows(); }
+    std::unique_ptr<TVectorD> list(new TVectorD(n));
+    Double_t* value = list->GetMatrixArray();
+    for (auto& piece : elem.second) {
+      std::copy(piece->GetMatrixArray(), piece->GetMatrixArray() + piece->GetNrows(), value);
+      value += piece->GetNrows();
+      piece.reset();
+    }
+    set.object[elem.first] = std::move(list);
+  }
+  set.piece.clear();
+}
+
+Bool_t HistogramMerger::RebuildExact(MergeSet& set)
+{
+  for (auto& elem : set.object) {
+    const std::string& path = elem.first;
+    if (path.size()<=6 || path.substr(path.size()-6)!="_Exact" || !elem.second || !elem.second->InheritsFrom("TH1")) continue;
+    auto it = set.object.find(path.substr(0, path.size()-6));
+    if (it==set.object.end() || !it->second || !it->second->InheritsFrom("TH1")) continue;
+    if (!HistogramStore::Rebuild((TH1*)it->second.get(), (TH1*)elem.second.get())) { std::cout << "[ERROR] Failed to set " << it->first << " from its exact sums" << std::endl; return false; }
+  }
+  return true;
+}
+
+Bool_t HistogramMerger::SameAxis(const TAxis* a, const TAxis* b)
+{
+  if (a->GetNbins()!=b->GetNbins() || a->GetXmin()!=b->GetXmin() || a->GetXmax()!=b->GetXmax()) return false;
+  if (a->IsVariableBinSize()!=b->IsVariableBinSize()) return false;
+  if (a->IsVariableBinSize()) {
+    for (Int_t i = 1; i <= a->GetNbins(); i++) { if (a->GetBinLowEdge(i)!=b->GetBinLowEdge(i)) return false; }
+  }
+  return true;
+}
+
+Bool_t HistogramMerger::SameBinning(const TH1* a, const TH1* b)
+{
+  // Same number of bins and range as booked from the VarInfo of each variable
+  if (a->GetDimension()!=b->GetDimension()) return false;
+  if (!SameAxis(a->GetXaxis(), b->GetXaxis())) return false;
+  if (a->GetDimension()>1 && !SameAxis(a->GetYaxis(), b->GetYaxis())) return false;
+  if (a->GetDimension()>2 && !SameAxis(a->GetZaxis(), b->GetZaxis())) return false;
+  return true;
+}
+
+Bool_t HistogramMerger::SameBinning(const THnBase* a, const THnBase* b)
+{
+  if (a->GetNdimensions()!=b->GetNdimensions()) return false;
+  for (Int_t i = 0; i < a->GetNdimensions(); i++) { if (!SameAxis(a->GetAxis(i), b->GetAxis(i))) return false; }
+  return true;
+}
+
+Bool_t HistogramMerger::WriteFile(const std::string& fileName, const MergeSet& set)
+{
+  std::unique_ptr<TFile> file(TFile::Open(fileName.c_str(), "RECREATE", "", ROOT::CompressionSettings(ROOT::kLZMA, 5)));
+  if (!file || !file->IsOpen()) { std::cout << "[ERROR] Failed to create " << fileName << std::endl; return false; }
+  for (auto& elem : set.object) {
+    if (!elem.second) continue;
+    // Recreate the directory structure of the inputs
+    TDirectory* dir = file.get();
+    std::string path = elem.first;
+    size_t pos;
+    while ((pos = path.find('/'))!=std::string::npos) {
+      const std::string dirName = path.substr(0, pos);
+      TDirectory* subDir = dir->GetDirectory(dirName.c_str());
+      dir = (subDir ? subDir : dir->mkdir(dirName.c_str()));
+      path = path.substr(pos+1);
+    }
+    dir->WriteTObject(elem.second.get(), path.c_str(), "Overwrite");
+  }
+  file->Close();
+  return true;
+}
+
+void HistogramMerger::SetError(const std::string& message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!error_) message_ = message;
+  error_ = true;
+}
+
+#endif
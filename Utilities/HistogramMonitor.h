@@ -0,0 +1,207 @@
+#ifndef HistogramMonitor_h
+#define HistogramMonitor_h
+
+// Header file for ROOT classes
+#include <TROOT.h>
+#include <TFile.h>
+#include <TH1.h>
+#include <TNamed.h>
+#include <TSystem.h>
+#include <THttpServer.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <csignal>
+#include <ctime>
+
+// Header file for the histograms
+#include "Histogram.h"
+
+
+typedef std::vector< std::unique_ptr<TH1D> > HistogramSnapshot;
+
+
+// Publishes copies of the histograms while the event loop runs. The loop calls Poll
+// at points where the histograms are consistent (e.g. between two batches); a snapshot
+// is taken every interval or when the job receives SIGUSR1. The copies are written by
+// a background thread to a temporary file that is then renamed, so readers never see
+// a partial file, and optionally served by a local THttpServer.
+class HistogramMonitor {
+
+ public :
+
+  HistogramMonitor();
+  virtual ~HistogramMonitor();
+
+  virtual Bool_t       Start         (const std::string&, const double interval=60., const Int_t httpPort=-1);
+  virtual void         Poll          (Histogram&, const Long64_t nProcessed=-1);
+  virtual void         Snapshot      (Histogram&, const Long64_t nProcessed=-1);
+  virtual void         Stop          (void);
+  virtual UInt_t       GetNSnapshots (void) { return nSnapshots_; }
+
+ private:
+
+  static void          HandleSignal  (int);
+  virtual void         Publish       (const HistogramSnapshot&);
+  virtual void         Write         (void);
+
+  static volatile std::sig_atomic_t                  signal_;
+
+  std::string                                        fileName_;
+  std::chrono::duration<double>                      interval_;
+  std::chrono::steady_clock::time_point              last_;
+  UInt_t                                             nSnapshots_;
+  bool                                               running_;
+
+  // Single slot handed to the writer thread: a newer snapshot replaces a pending one
+  HistogramSnapshot                                  pending_;
+  std::string                                        pendingInfo_;
+  bool                                               hasPending_;
+  bool                                               stop_;
+  std::mutex                                         mutex_;
+  std::condition_variable                            cond_;
+  std::thread                                        writer_;
+
+  // Local HTTP endpoint, served from the event loop thread
+  std::unique_ptr<THttpServer>                       server_;
+  HistogramSnapshot                                  served_;
+};
+
+volatile std::sig_atomic_t HistogramMonitor::signal_ = 0;
+
+HistogramMonitor::HistogramMonitor() : nSnapshots_(0), running_(false), hasPending_(false), stop_(false)
+{
+}
+
+HistogramMonitor::~HistogramMonitor()
+{
+  Stop();
+}
+
+void HistogramMonitor::HandleSignal(int)
+{
+  signal_ = 1;
+}
+
+Bool_t HistogramMonitor::Start(const std::string& fileName, const double interval, const Int_t httpPort)
+{
+  Stop();
+  // The snapshots are written while other threads read the input files
+  ROOT::EnableThreadSafety();
+  fileName_ = fileName;
+  interval_ = std::chrono::duration<double>(interval);
+  last_ = std::chrono::steady_clock::now();
+  signal_ = 0;
+  std::signal(SIGUSR1, HistogramMonitor::HandleSignal);
+  if (httpPort >= 0) {
+    server_.reset(new THttpServer(Form("http:%d", httpPort)));
+    // Requests are only processed when Poll is called
+    server_->SetTimer(0, kTRUE);
+    std::cout << "[INFO] Serving histogram snapshots on http://localhost:" << httpPort << std::endl;
+  }
+  stop_ = false;
+  hasPending_ = false;
+  if (fileName_!="") writer_ = std::thread(&HistogramMonitor::Write, this);
+  running_ = true;
+  std::cout << "[INFO] Histogram snapshots every " << interval << " s (or on SIGUSR1 to process " << gSystem->GetPid() << ")" << std::endl;
+  return true;
+}
+
+void HistogramMonitor::Poll(Histogram& hist, const Long64_t nProcessed)
+{
+  if (!running_) return;
+  if (server_) server_->ProcessRequests();
+  if (signal_ || (interval_.count() > 0. && (std::chrono::steady_clock::now() - last_) >= interval_)) {
+    signal_ = 0;
+    Snapshot(hist, nProcessed);
+  }
+}
+
+void HistogramMonitor::Snapshot(Histogram& hist, const Long64_t nProcessed)
+{
+  if (!running_) return;
+  last_ = std::chrono::steady_clock::now();
+  nSnapshots_++;
+  // Copy the histograms on the event loop thread, which owns them
+  hist.Sync();
+  const Bool_t addDirectory = TH1::AddDirectoryStatus();
+  TH1::AddDirectory(kFALSE);
+  HistogramSnapshot snapshot;
+  for (auto& type : hist.TH1D_) {
+    for (auto& var : type.second) {
+      if (var.second) snapshot.push_back(std::unique_ptr<TH1D>((TH1D*)var.second->Clone()));
+    }
+  }
+  TH1::AddDirectory(addDirectory);
+  if (server_) Publish(snapshot);
+  if (fileName_=="") return;
+  const std::time_t now = std::time(0);
+  const std::string info = Form("Snapshot %u after %lld entries at %s", nSnapshots_, nProcessed, std::ctime(&now));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ = std::move(snapshot);
+    pendingInfo_ = info;
+    hasPending_ = true;
+  }
+  cond_.notify_one();
+}
+
+void HistogramMonitor::Publish(const HistogramSnapshot& snapshot)
+{
+  for (auto& h : served_) { server_->Unregister(h.get()); }
+  served_.clear();
+  for (auto& h : snapshot) {
+    served_.push_back(std::unique_ptr<TH1D>((TH1D*)h->Clone()));
+    server_->Register("/Snapshot", served_.back().get());
+  }
+}
+
+void HistogramMonitor::Write(void)
+{
+  const std::string tmpName = fileName_ + ".tmp";
+  while (true) {
+    HistogramSnapshot snapshot;
+    std::string info;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]{ return (stop_ || hasPending_); });
+      if (!hasPending_) break;
+      snapshot = std::move(pending_);
+      info = pendingInfo_;
+      hasPending_ = false;
+    }
+    std::unique_ptr<TFile> file(TFile::Open(tmpName.c_str(), "RECREATE"));
+    if (!file || !file->IsOpen()) { std::cout << "[ERROR] Failed to create the snapshot file " << tmpName << std::endl; continue; }
+    file->cd();
+    for (auto& h : snapshot) { h->Write(); }
+    TNamed("Info", info.c_str()).Write();
+    file->Close();
+    if (gSystem->Rename(tmpName.c_str(), fileName_.c_str()) != 0) { std::cout << "[ERROR] Failed to rename the snapshot file to " << fileName_ << std::endl; }
+  }
+}
+
+void HistogramMonitor::Stop(void)
+{
+  if (!running_) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_one();
+  // The last pending snapshot is still written
+  if (writer_.joinable()) writer_.join();
+  std::signal(SIGUSR1, SIG_DFL);
+  if (server_) { for (auto& h : served_) { server_->Unregister(h.get()); } }
+  served_.clear();
+  server_.reset();
+  running_ = false;
+}
+
+#endif
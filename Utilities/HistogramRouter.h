@@ -0,0 +1,72 @@
+#ifndef HistogramRouter_h
+#define HistogramRouter_h
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <limits>
+
+// Header file for the histograms
+#include "Histogram.h"
+
+
+// Histograms of one type filled for the events of a sample within a run range
+typedef struct HistRoute {
+  UInt_t                           runMin;
+  UInt_t                           runMax;
+  size_t                           index;    // index of the type in the booking order
+  std::vector< HistogramStore* >   handle;   // one per routed variable, null if not booked for this type
+} HistRoute;
+
+
+// Decides once, at booking time, which histogram types are filled by each sample, so that
+// the event loop only compares the run number and walks a flat list of routes.
+class HistogramRouter {
+
+ public :
+
+  HistogramRouter(const std::vector< std::string >& varNames) : varNames_(varNames) {};
+  virtual ~HistogramRouter() {};
+
+  virtual void                             Add      (const std::string& sample, const size_t index, Histogram& hist, const std::string& type,
+                                                     const UInt_t runMin=0, const UInt_t runMax=std::numeric_limits<UInt_t>::max());
+  virtual const std::vector< HistRoute >&  Routes   (const std::string& sample) { return routes_[sample]; }
+  virtual int                              VarIndex (const std::string&) const;
+  virtual void                             Print    (void) const;
+
+ private:
+
+  std::vector< std::string >                             varNames_;
+  std::map< std::string , std::vector< HistRoute > >     routes_;
+  std::map< std::string , std::vector< std::string > >   types_;
+};
+
+void HistogramRouter::Add(const std::string& sample, const size_t index, Histogram& hist, const std::string& type, const UInt_t runMin, const UInt_t runMax)
+{
+  HistRoute route = { runMin , runMax , index , std::vector< HistogramStore* >(varNames_.size(), 0) };
+  for (size_t i = 0; i < varNames_.size(); i++) { route.handle[i] = hist.Handle(type, varNames_[i]); }
+  routes_[sample].push_back(route);
+  types_[sample].push_back(type);
+}
+
+int HistogramRouter::VarIndex(const std::string& varName) const
+{
+  for (size_t i = 0; i < varNames_.size(); i++) { if (varNames_[i]==varName) return i; }
+  return -1;
+}
+
+void HistogramRouter::Print(void) const
+{
+  for (auto& sample : routes_) {
+    for (size_t i = 0; i < sample.second.size(); i++) {
+      const HistRoute& route = sample.second[i];
+      std::cout << "[INFO] Route " << sample.first << " -> " << types_.at(sample.first)[i];
+      if (route.runMin > 0 || route.runMax < std::numeric_limits<UInt_t>::max()) std::cout << " (runs " << route.runMin << " - " << route.runMax << ")";
+      std::cout << std::endl;
+    }
+  }
+}
+
+#endif
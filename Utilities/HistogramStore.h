@@ -0,0 +1,334 @@
+#ifndef HistogramStore_h
+#define HistogramStore_h
+
+// Header file for ROOT classes
+#include <TH1.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+
+// Header file for the bin memory
+#include "HistogramArena.h"
+
+
+// Bin accumulators of a histogram:
+//  kCount    : 64-bit integer counts, for unweighted fills
+//  kWeighted : sums of w and w^2 in 128-bit fixed point
+//  kShared   : the same fixed-point sums kept as 64-bit words updated with atomic additions, so
+//              that a single copy of a very large histogram can be filled by several threads
+enum StoreMode { kCount , kWeighted , kShared };
+
+// Fixed-point sums, in units of 2^-32
+__extension__ typedef __int128           FixedSum;
+__extension__ typedef unsigned __int128  UFixedSum;
+
+
+// Binned storage of a 1-D histogram with uniform bins, filled in the event loop and exported
+// to a ROOT histogram for drawing and saving. All the accumulators are integers: each weight
+// is rounded once to the fixed-point unit, and the sums are then exact, so they do not depend
+// on the order of the fills nor on the split of the events between threads or jobs.
+// Weights that are not finite or larger than 2^40 are counted as an entry of weight zero.
+// The exact sums are also exported as 32-bit limbs in a TH1D (ExportExact), which TH1::Add
+// (hadd, HistogramMerger) adds without rounding for up to 2^21 inputs. Rebuild then sets the
+// merged histogram from them, with the same bits as the output of a single job.
+// The bins live in a HistogramArena and are only allocated at the first fill, except for
+// shared stores which are allocated when booked so that the threads never race to do it.
+class HistogramStore {
+
+ public :
+
+  HistogramStore(HistogramArena& arena, const UInt_t nBin, const double min, const double max, const StoreMode mode=kCount);
+  virtual ~HistogramStore() {};
+
+  inline void          Fill        (const double x, const double w=1.);
+  virtual Bool_t       Merge       (const HistogramStore&);
+  virtual void         Export      (TH1*) const;
+  virtual TH1D*        ExportExact (const std::string&) const;
+  virtual Bool_t       Import      (const TH1*);
+  virtual Bool_t       ImportExact (const TH1*);
+  static Bool_t        Rebuild     (TH1*, const TH1*);
+  virtual void         Reset       (void);
+
+  StoreMode            Mode        (void) const { return mode_; }
+  UInt_t               GetNbins    (void) const { return nBin_; }
+  double               GetXmin     (void) const { return min_; }
+  double               GetXmax     (void) const { return max_; }
+  bool                 IsFilled    (void) const { return (data_!=0); }
+  double               Content     (const UInt_t bin) const { return ToDouble(SumW(bin)); }
+  double               Error2      (const UInt_t bin) const { return ToDouble(SumW2(bin)); }
+  ULong64_t            Entries     (void) const { return (mode_==kShared ? sharedEntries_.load() : entries_); }
+
+ private:
+
+  HistogramStore(const HistogramStore&);
+  HistogramStore& operator=(const HistogramStore&);
+
+  virtual void         Allocate    (void);
+  inline UInt_t        Bin         (const double x) const;
+  inline void          Add         (const UInt_t bin, const FixedSum w, const FixedSum w2);
+  FixedSum             SumW        (const UInt_t) const;
+  FixedSum             SumW2       (const UInt_t) const;
+  inline static FixedSum Fixed     (const double);
+  static double        ToDouble    (const FixedSum v) { return std::ldexp(double(v), -32); }
+  static Bool_t        Decode      (const TH1*, const Int_t, UFixedSum&);
+
+  // Bins of each mode: one count, { sumw , sumw2 } or { sumw low , high , sumw2 low , high } per bin
+  inline ULong64_t*              Count  (void) const { return static_cast<ULong64_t*>(data_); }
+  inline FixedSum*               Sums   (const UInt_t bin) const { return static_cast<FixedSum*>(data_) + 2*bin; }
+  inline std::atomic<ULong64_t>* Shared (const UInt_t bin) const { return static_cast<std::atomic<ULong64_t>*>(data_) + 4*bin; }
+
+  // Number of bins of the TH1D written by ExportExact: 8 limbs per bin and 4 for the entries
+  UInt_t               NExact      (void) const { return 8*(nBin_ + 2) + 4; }
+
+  HistogramArena*                            arena_;
+  void*                                      data_;
+  UInt_t                                     nBin_;    // bin 0 is the underflow and bin nBin+1 the overflow, as in ROOT
+  double                                     min_;
+  double                                     max_;
+  double                                     invWidth_;
+  StoreMode                                  mode_;
+  ULong64_t                                  entries_;
+  std::atomic<ULong64_t>                     sharedEntries_;
+};
+
+// Fill of a store deferred to the end of a block of events, so that the fills of the block
+// are done together
+typedef struct StoreFill {
+  HistogramStore*  store;
+  double           x;
+  double           w;
+} StoreFill;
+
+HistogramStore::HistogramStore(HistogramArena& arena, const UInt_t nBin, const double min, const double max, const StoreMode mode) :
+  arena_(&arena), data_(0), nBin_(nBin), min_(min), max_(max), invWidth_(nBin/(max - min)), mode_(mode), entries_(0), sharedEntries_(0)
+{
+  if (mode_==kShared) Allocate();
+}
+
+void HistogramStore::Allocate(void)
+{
+  const size_t n = nBin_ + 2;
+  switch (mode_) {
+  case kCount    : data_ = arena_->Allocate(n*sizeof(ULong64_t)); break;
+  case kWeighted : data_ = arena_->Allocate(2*n*sizeof(FixedSum)); break;
+  case kShared   :
+    data_ = arena_->Allocate(4*n*sizeof(std::atomic<ULong64_t>));
+    for (size_t i = 0; i < 4*n; i++) { new (static_cast<std::atomic<ULong64_t>*>(data_) + i) std::atomic<ULong64_t>(0); }
+    break;
+  }
+}
+
+inline UInt_t HistogramStore::Bin(const double x) const
+{
+  if (!(x >= min_)) return 0;
+  if (x >= max_) return nBin_ + 1;
+  const UInt_t bin = UInt_t((x - min_)*invWidth_) + 1;
+  return (bin > nBin_ ? nBin_ : bin);
+}
+
+inline FixedSum HistogramStore::Fixed(const double v)
+{
+  // Rounded to the nearest unit, the same way for every fill (the bound keeps it in 128 bits)
+  if (!(std::abs(v) <= 1237940039285380274899124224.)) return 0;   // 2^90
+  return FixedSum(std::nearbyint(std::ldexp(v, 32)));
+}
+
+inline void HistogramStore::Add(const UInt_t bin, const FixedSum w, const FixedSum w2)
+{
+  if (mode_==kWeighted) {
+    FixedSum* s = Sums(bin);
+    s[0] += w;
+    s[1] += w2;
+    return;
+  }
+  // Two's complement additions of the low and high words, the carry of the low word is added
+  // to the high one: the words are exact once all the additions are done, in any order
+  std::atomic<ULong64_t>* s = Shared(bin);
+  for (const FixedSum v : { w , w2 }) {
+    const ULong64_t lo = ULong64_t(UFixedSum(v)), hi = ULong64_t(UFixedSum(v) >> 64);
+    const ULong64_t old = s[0].fetch_add(lo, std::memory_order_relaxed);
+    s[1].fetch_add(hi + (old + lo < old ? 1 : 0), std::memory_order_relaxed);
+    s += 2;
+  }
+}
+
+inline void HistogramStore::Fill(const double x, const double w)
+{
+  if (!data_) Allocate();
+  const UInt_t bin = Bin(x);
+  const double v = (std::abs(w) <= 1099511627776. ? w : 0.);   // 2^40, also rejects NaN
+  switch (mode_) {
+  case kCount :
+    // Count stores are only booked for unweighted fills
+    Count()[bin]++;
+    entries_++;
+    break;
+  case kWeighted :
+    Add(bin, Fixed(v), Fixed(v*v));
+    entries_++;
+    break;
+  case kShared :
+    Add(bin, Fixed(v), Fixed(v*v));
+    sharedEntries_.fetch_add(1, std::memory_order_relaxed);
+    break;
+  }
+}
+
+FixedSum HistogramStore::SumW(const UInt_t bin) const
+{
+  if (!data_) return 0;
+  switch (mode_) {
+  case kCount    : return FixedSum(Count()[bin]) << 32;
+  case kWeighted : return Sums(bin)[0];
+  case kShared   : return FixedSum((UFixedSum(Shared(bin)[1].load()) << 64) | Shared(bin)[0].load());
+  }
+  return 0;
+}
+
+FixedSum HistogramStore::SumW2(const UInt_t bin) const
+{
+  if (!data_) return 0;
+  switch (mode_) {
+  case kCount    : return FixedSum(Count()[bin]) << 32;
+  case kWeighted : return Sums(bin)[1];
+  case kShared   : return FixedSum((UFixedSum(Shared(bin)[3].load()) << 64) | Shared(bin)[2].load());
+  }
+  return 0;
+}
+
+Bool_t HistogramStore::Merge(const HistogramStore& other)
+{
+  if (other.nBin_!=nBin_ || other.min_!=min_ || other.max_!=max_) { std::cout << "[ERROR] Merging histogram stores with different binning!" << std::endl; return false; }
+  if (mode_==kCount && other.mode_!=kCount) { std::cout << "[ERROR] Weighted fills can not be merged into a count store!" << std::endl; return false; }
+  if (!other.data_) return true;
+  if (!data_) Allocate();
+  for (UInt_t bin = 0; bin < nBin_ + 2; bin++) {
+    if (mode_==kCount) Count()[bin] += other.Count()[bin];
+    else Add(bin, other.SumW(bin), other.SumW2(bin));
+  }
+  if (mode_==kShared) { sharedEntries_.fetch_add(other.Entries()); }
+  else { entries_ += other.Entries(); }
+  return true;
+}
+
+void HistogramStore::Export(TH1* h) const
+{
+  if (!h) return;
+  if (h->GetNbinsX()!=int(nBin_)) { std::cout << "[ERROR] Exporting a histogram store to " << h->GetName() << " with a different binning!" << std::endl; return; }
+  for (UInt_t bin = 0; bin < nBin_ + 2; bin++) {
+    h->SetBinContent(bin, Content(bin));
+    if (h->GetSumw2N()>0) h->SetBinError(bin, std::sqrt(Error2(bin)));
+  }
+  // The statistics are recomputed from the bins, the number of entries is the true one
+  h->ResetStats();
+  h->SetEntries(double(Entries()));
+}
+
+TH1D* HistogramStore::ExportExact(const std::string& name) const
+{
+  // Each sum is written as four 32-bit limbs of its two's complement, lowest first: the sum of
+  // the limbs of many inputs stays exact in double precision, and the carries are resolved when
+  // the limbs are decoded
+  TH1D* h = new TH1D(name.c_str(), name.c_str(), NExact(), 0., NExact());
+  h->SetDirectory(0);
+  auto setLimbs = [&](const Int_t first, const UFixedSum v) {
+    for (Int_t k = 0; k < 4; k++) { h->SetBinContent(first + k + 1, double(ULong64_t(v >> (32*k)) & 0xFFFFFFFFULL)); }
+  };
+  for (UInt_t bin = 0; bin < nBin_ + 2; bin++) {
+    setLimbs(8*bin, UFixedSum(SumW(bin)));
+    setLimbs(8*bin + 4, UFixedSum(SumW2(bin)));
+  }
+  setLimbs(8*(nBin_ + 2), UFixedSum(Entries()));
+  return h;
+}
+
+Bool_t HistogramStore::Decode(const TH1* h, const Int_t first, UFixedSum& v)
+{
+  // Sum of the limbs modulo 2^128, each limb must be an integer below 2^53
+  v = 0;
+  for (Int_t k = 0; k < 4; k++) {
+    const double limb = h->GetBinContent(first + k + 1);
+    if (!(limb >= 0. && limb < 9007199254740992. && limb==std::floor(limb))) return false;
+    v += UFixedSum(ULong64_t(limb)) << (32*k);
+  }
+  return true;
+}
+
+Bool_t HistogramStore::Rebuild(TH1* h, const TH1* exact)
+{
+  // Set a histogram written by Export from its exact sums, e.g. once the partial outputs are added
+  if (!h || !exact || exact->GetNbinsX()!=8*(h->GetNbinsX() + 2) + 4) { std::cout << "[ERROR] Exact sums of a different binning!" << std::endl; return false; }
+  const Int_t nBin = h->GetNbinsX();
+  UFixedSum sumw, sumw2, entries;
+  for (Int_t bin = 0; bin < nBin + 2; bin++) {
+    if (!Decode(exact, 8*bin, sumw) || !Decode(exact, 8*bin + 4, sumw2)) { std::cout << "[ERROR] Invalid exact sums of " << h->GetName() << std::endl; return false; }
+    h->SetBinContent(bin, ToDouble(FixedSum(sumw)));
+    if (h->GetSumw2N()>0) h->SetBinError(bin, std::sqrt(ToDouble(FixedSum(sumw2))));
+  }
+  if (!Decode(exact, 8*(nBin + 2), entries)) { std::cout << "[ERROR] Invalid exact sums of " << h->GetName() << std::endl; return false; }
+  h->ResetStats();
+  h->SetEntries(double(ULong64_t(entries)));
+  return true;
+}
+
+Bool_t HistogramStore::Import(const TH1* h)
+{
+  // Add the content of a histogram written by Export, e.g. read back from a partial output
+  // without its exact sums: the bins are then rounded to the fixed-point unit
+  if (!h || h->GetNbinsX()!=int(nBin_)) { std::cout << "[ERROR] Importing a histogram with a different binning!" << std::endl; return false; }
+  const bool weighted = (h->GetSumw2N()>0);
+  if (mode_==kCount && weighted) { std::cout << "[ERROR] Weighted histogram " << h->GetName() << " can not be imported into a count store!" << std::endl; return false; }
+  if (h->GetEntries()==0.) return true;
+  if (!data_) Allocate();
+  for (UInt_t bin = 0; bin < nBin_ + 2; bin++) {
+    const double w = h->GetBinContent(bin), w2 = (weighted ? std::pow(h->GetBinError(bin), 2.) : w);
+    if (mode_==kCount) Count()[bin] += ULong64_t(std::llround(w));
+    else Add(bin, Fixed(w), Fixed(w2));
+  }
+  if (mode_==kShared) { sharedEntries_.fetch_add(ULong64_t(h->GetEntries())); }
+  else { entries_ += ULong64_t(h->GetEntries()); }
+  return true;
+}
+
+Bool_t HistogramStore::ImportExact(const TH1* exact)
+{
+  // Add the exact sums written by ExportExact (and possibly added over several outputs)
+  if (!exact || exact->GetNbinsX()!=int(NExact())) { std::cout << "[ERROR] Importing exact sums with a different binning!" << std::endl; return false; }
+  std::vector<UFixedSum> sumw(nBin_ + 2), sumw2(nBin_ + 2);
+  UFixedSum entries;
+  for (UInt_t bin = 0; bin < nBin_ + 2; bin++) {
+    if (!Decode(exact, 8*bin, sumw[bin]) || !Decode(exact, 8*bin + 4, sumw2[bin])) { std::cout << "[ERROR] Invalid exact sums in " << exact->GetName() << std::endl; return false; }
+    // Count stores only take whole unweighted entries
+    if (mode_==kCount && (sumw[bin]!=sumw2[bin] || (sumw[bin] & 0xFFFFFFFFULL)!=0)) {
+      std::cout << "[ERROR] Weighted sums " << exact->GetName() << " can not be imported into a count store!" << std::endl; return false;
+    }
+  }
+  if (!Decode(exact, 8*(nBin_ + 2), entries)) { std::cout << "[ERROR] Invalid exact sums in " << exact->GetName() << std::endl; return false; }
+  if (entries==0) return true;
+  if (!data_) Allocate();
+  for (UInt_t bin = 0; bin < nBin_ + 2; bin++) {
+    if (mode_==kCount) Count()[bin] += ULong64_t(sumw[bin] >> 32);
+    else Add(bin, FixedSum(sumw[bin]), FixedSum(sumw2[bin]));
+  }
+  if (mode_==kShared) { sharedEntries_.fetch_add(ULong64_t(entries)); }
+  else { entries_ += ULong64_t(entries); }
+  return true;
+}
+
+void HistogramStore::Reset(void)
+{
+  entries_ = 0;
+  sharedEntries_ = 0;
+  if (!data_) return;
+  const size_t n = nBin_ + 2;
+  if (mode_==kCount) std::fill(Count(), Count() + n, 0);
+  if (mode_==kWeighted) std::fill(Sums(0), Sums(0) + 2*n, FixedSum(0));
+  if (mode_==kShared) { for (size_t i = 0; i < 4*n; i++) { Shared(0)[i] = 0; } }
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef KinematicCache_h
+#define KinematicCache_h
+
+// Header file for ROOT classes
+#include <TLorentzVector.h>
+
+// Header file for c++ classes
+#include <vector>
+#include <algorithm>
+
+
+typedef std::vector<TLorentzVector>           VTLorentzVector;
+
+// Quantities derived from the momenta of a collection
+enum KinVar { kPt = 0, kEta = 1, kPhi = 2, kRapidity = 3, kMass = 4, kNKinVar = 5 };
+
+// Derived quantities of the momenta of one column (e.g. Reco_Muon_Mom), each computed at most once
+// on first request. A value is valid if it was computed in the current generation: starting a new
+// generation invalidates all of them without touching the arrays, which keep their memory.
+class KinematicCache {
+
+ public :
+
+  KinematicCache() : generation_(1) {};
+
+  void                 Invalidate (void);
+  inline double        Get        (const VTLorentzVector& column, const KinVar var, const size_t i);
+  const double*        All        (const VTLorentzVector& column, const KinVar var);
+
+ private:
+
+  static inline double Compute    (const TLorentzVector&, const KinVar);
+
+  std::vector<double>  value_[kNKinVar];
+  std::vector<UInt_t>  stamp_[kNKinVar];   // generation in which each value was computed
+  UInt_t               generation_;
+};
+
+void KinematicCache::Invalidate(void)
+{
+  // Only reset the stamps when the generation counter wraps around
+  if (++generation_ == 0) {
+    for (auto& stamp : stamp_) { std::fill(stamp.begin(), stamp.end(), 0); }
+    generation_ = 1;
+  }
+}
+
+double KinematicCache::Get(const VTLorentzVector& column, const KinVar var, const size_t i)
+{
+  std::vector<UInt_t>& stamp = stamp_[var];
+  if (stamp.size() < column.size()) { stamp.resize(column.size(), 0); value_[var].resize(column.size()); }
+  if (stamp[i] != generation_) {
+    value_[var][i] = Compute(column[i], var);
+    stamp[i] = generation_;
+  }
+  return value_[var][i];
+}
+
+const double* KinematicCache::All(const VTLorentzVector& column, const KinVar var)
+{
+  for (size_t i = 0; i < column.size(); i++) { Get(column, var, i); }
+  return value_[var].data();
+}
+
+double KinematicCache::Compute(const TLorentzVector& p, const KinVar var)
+{
+  switch (var) {
+  case kPt       : return p.Pt();
+  case kEta      : return (p.Pt() > 0. ? p.Eta() : 0.);
+  case kPhi      : return p.Phi();
+  case kRapidity : return p.Rapidity();
+  case kMass     : return p.M();
+  default        : return 0.;
+  }
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef PFIsolationGrid_h
+#define PFIsolationGrid_h
+
+// Header file for ROOT classes
+#include <TMath.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Header file for the forest readers
+#include "HiMuonTree.h"
+
+
+// PF candidate types (PF_Candidate_Id), combined as bits in the isolation queries
+enum PFCandidateId {
+  kPFX = 0, kPFChargedHadron = 1, kPFElectron = 2, kPFMuon = 3, kPFPhoton = 4, kPFNeutralHadron = 5, kPFHFHadron = 6, kPFHFEM = 7
+};
+const UInt_t kPFAll     = 0xFF;
+const UInt_t kPFCharged = (1 << kPFChargedHadron) | (1 << kPFElectron) | (1 << kPFMuon);
+const UInt_t kPFNeutral = (1 << kPFPhoton) | (1 << kPFNeutralHadron) | (1 << kPFHFHadron) | (1 << kPFHFEM);
+
+
+// PF candidates of one event sorted into cells of an eta-phi grid, so that the sum of the pT
+// in a cone only visits the few cells overlapping the cone instead of all the candidates. The
+// grid is filled once per event with a counting sort (linear in the number of candidates), the
+// phi cells wrap around, and the candidates beyond the eta range go to the first or last row.
+// For example, the isolation of the first muon of a dimuon, with both muons vetoed:
+//   PFIsolationGrid grid;
+//   forest.GetEntry(entry);
+//   grid.Fill(forest.Muon());
+//   const float vEta[2] = { mu1.Eta() , mu2.Eta() }, vPhi[2] = { mu1.Phi() , mu2.Phi() };
+//   const double iso1 = grid.Sum(vEta[0], vPhi[0], 0.3, vEta, vPhi, 2, 0.01, kPFCharged);
+class PFIsolationGrid {
+
+ public :
+
+  PFIsolationGrid(const float cellSize=0.1, const float etaMax=5.0);
+  virtual ~PFIsolationGrid() {};
+
+  virtual void         Fill       (const std::vector<float>& eta, const std::vector<float>& phi, const std::vector<float>& pt,
+                                   const std::vector<UChar_t>& id, const std::vector<bool>& isPU);
+  virtual void         Fill       (HiMuonTree&);
+  virtual size_t       GetN       (void) const { return pt_.size(); }
+
+  // Sum of the pT of the candidates of the given types (bits of PFCandidateId) with dR < coneR of
+  // the axis and dR >= vetoR of the axis or of each veto direction (e.g. the two muons of a dimuon)
+  virtual double       Sum        (const float eta, const float phi, const float coneR, const float vetoR=0.,
+                                   const UInt_t idMask=kPFAll, const bool withPU=false) const;
+  virtual double       Sum        (const float eta, const float phi, const float coneR,
+                                   const float* vetoEta, const float* vetoPhi, const size_t nVeto, const float vetoR,
+                                   const UInt_t idMask=kPFAll, const bool withPU=false) const;
+
+ private:
+
+  inline int           EtaCell    (const float eta) const;
+  inline int           PhiCell    (const float phi) const;
+  static inline float  DeltaPhi   (const float phi1, const float phi2);
+
+  float                     cellSize_;
+  float                     etaMax_;
+  int                       nEta_;
+  int                       nPhi_;
+  float                     phiCell_;
+
+  // CANDIDATES SORTED BY CELL, those of cell i are in [cellStart_[i], cellStart_[i+1])
+  std::vector<UInt_t>       cellStart_;
+  std::vector<float>        eta_, phi_, pt_;
+  std::vector<UChar_t>      id_;
+  std::vector<char>         isPU_;
+  // FILL BUFFERS
+  std::vector<UInt_t>       cell_;
+};
+
+PFIsolationGrid::PFIsolationGrid(const float cellSize, const float etaMax) : cellSize_(cellSize > 0. ? cellSize : 0.1), etaMax_(etaMax)
+{
+  nEta_    = std::max(1, int(std::ceil(2.*etaMax_/cellSize_)));
+  nPhi_    = std::max(1, int(std::floor(TMath::TwoPi()/cellSize_)));
+  phiCell_ = TMath::TwoPi()/nPhi_;
+  cellStart_.assign(nEta_*nPhi_ + 1, 0);
+}
+
+int PFIsolationGrid::EtaCell(const float eta) const
+{
+  const int i = int(std::floor((eta + etaMax_)/cellSize_));
+  return std::min(std::max(i, 0), nEta_-1);
+}
+
+int PFIsolationGrid::PhiCell(const float phi) const
+{
+  int i = int(std::floor((phi + TMath::Pi())/phiCell_)) % nPhi_;
+  return (i < 0 ? i + nPhi_ : i);
+}
+
+float PFIsolationGrid::DeltaPhi(const float phi1, const float phi2)
+{
+  float dPhi = phi1 - phi2;
+  while (dPhi >  TMath::Pi()) dPhi -= TMath::TwoPi();
+  while (dPhi < -TMath::Pi()) dPhi += TMath::TwoPi();
+  return dPhi;
+}
+
+void PFIsolationGrid::Fill(const std::vector<float>& eta, const std::vector<float>& phi, const std::vector<float>& pt,
+                           const std::vector<UChar_t>& id, const std::vector<bool>& isPU)
+{
+  const size_t n = pt.size();
+  if (eta.size()!=n || phi.size()!=n || id.size()!=n) {
+    std::cout << "[ERROR] Inconsistent number of PF candidates, the isolation grid is left empty!" << std::endl;
+    std::fill(cellStart_.begin(), cellStart_.end(), 0);
+    eta_.clear(); phi_.clear(); pt_.clear(); id_.clear(); isPU_.clear();
+    return;
+  }
+  // Count the candidates per cell, then place them at the start of their cell
+  std::fill(cellStart_.begin(), cellStart_.end(), 0);
+  cell_.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    cell_[i] = EtaCell(eta[i])*nPhi_ + PhiCell(phi[i]);
+    cellStart_[cell_[i] + 1]++;
+  }
+  for (size_t c = 1; c < cellStart_.size(); c++) { cellStart_[c] += cellStart_[c-1]; }
+  eta_.resize(n); phi_.resize(n); pt_.resize(n); id_.resize(n); isPU_.resize(n);
+  std::vector<UInt_t> next(cellStart_.begin(), cellStart_.end()-1);
+  for (size_t i = 0; i < n; i++) {
+    const UInt_t j = next[cell_[i]]++;
+    eta_[j] = eta[i]; phi_[j] = phi[i]; pt_[j] = pt[i]; id_[j] = id[i];
+    isPU_[j] = (i < isPU.size() ? isPU[i] : false);
+  }
+}
+
+void PFIsolationGrid::Fill(HiMuonTree& muon)
+{
+  // The candidates are sorted straight from the branch buffers of the reader
+  Fill(muon.PF_Candidate_Eta_Ref(), muon.PF_Candidate_Phi_Ref(), muon.PF_Candidate_Pt_Ref(), muon.PF_Candidate_Id_Ref(), muon.PF_Candidate_isPU_Ref());
+}
+
+double PFIsolationGrid::Sum(const float eta, const float phi, const float coneR, const float vetoR, const UInt_t idMask, const bool withPU) const
+{
+  return Sum(eta, phi, coneR, &eta, &phi, 1, vetoR, idMask, withPU);
+}
+
+double PFIsolationGrid::Sum(const float eta, const float phi, const float coneR,
+                            const float* vetoEta, const float* vetoPhi, const size_t nVeto, const float vetoR,
+                            const UInt_t idMask, const bool withPU) const
+{
+  if (pt_.empty() || coneR <= 0.) return 0.;
+  const float cone2 = coneR*coneR, veto2 = vetoR*vetoR;
+  // Cells overlapping the square around the cone, all the phi cells if the cone is wider than 2pi
+  const int etaLo = EtaCell(eta - coneR), etaHi = EtaCell(eta + coneR);
+  const int nPhiCells = int(std::ceil(coneR/phiCell_));
+  const int phiC = PhiCell(phi);
+  const int phiLo = (2*nPhiCells + 1 >= nPhi_ ? 0 : phiC - nPhiCells);
+  const int phiHi = (2*nPhiCells + 1 >= nPhi_ ? nPhi_ - 1 : phiC + nPhiCells);
+  double sum = 0.;
+  for (int iEta = etaLo; iEta <= etaHi; iEta++) {
+    for (int iPhi = phiLo; iPhi <= phiHi; iPhi++) {
+      const int c = iEta*nPhi_ + ((iPhi % nPhi_) + nPhi_) % nPhi_;
+      for (UInt_t j = cellStart_[c]; j < cellStart_[c+1]; j++) {
+        // Types beyond the bits of the mask are never selected
+        if (id_[j] >= 32 || !(idMask & (1U << id_[j])) || (isPU_[j] && !withPU)) continue;
+        const float dEta = eta_[j] - eta, dPhi = DeltaPhi(phi_[j], phi);
+        if (dEta*dEta + dPhi*dPhi >= cone2) continue;
+        bool vetoed = false;
+        for (size_t v = 0; v < nVeto && !vetoed; v++) {
+          const float vEta = eta_[j] - vetoEta[v], vPhi = DeltaPhi(phi_[j], vetoPhi[v]);
+          vetoed = (vEta*vEta + vPhi*vPhi < veto2);
+        }
+        if (!vetoed) sum += pt_[j];
+      }
+    }
+  }
+  return sum;
+}
+
+#endif
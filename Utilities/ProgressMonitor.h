@@ -0,0 +1,164 @@
+#ifndef ProgressMonitor_h
+#define ProgressMonitor_h
+
+// Header file for ROOT classes
+#include <TFile.h>
+#include <TSystem.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+
+
+// Progress and throughput of the event loop. The counters and the stage timers can be
+// updated from any thread; Update only reports once per interval, from whichever thread
+// gets there first. The reports can also be appended as JSON lines to a log file.
+class ProgressMonitor {
+
+ public :
+
+  enum Stage { kRead = 0, kSelect = 1, kFill = 2, kNStage = 3 };
+
+  // Per-thread clock charging the elapsed time to the current stage, switched by the loop
+  class StageClock {
+   public :
+    StageClock(ProgressMonitor& monitor, const Stage stage) : monitor_(monitor), stage_(stage), start_(std::chrono::steady_clock::now()) {}
+    ~StageClock() { Switch(stage_); }
+    void Switch(const Stage stage) {
+      const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      monitor_.AddTime(stage_, now - start_);
+      stage_ = stage;
+      start_ = now;
+    }
+   private:
+    ProgressMonitor&                       monitor_;
+    Stage                                  stage_;
+    std::chrono::steady_clock::time_point  start_;
+  };
+
+  ProgressMonitor(const double interval=10., const std::string& logFile="");
+  virtual ~ProgressMonitor() {};
+
+  virtual void         Start         (const std::string&, const Long64_t);
+  virtual void         Update        (void);
+  virtual void         Finish        (void);
+
+  void                 AddEvents     (const Long64_t n) { nEvents_     += n; }
+  void                 AddCandidates (const Long64_t n) { nCandidates_ += n; }
+  void                 AddTime       (const Stage stage, const std::chrono::steady_clock::duration t) { time_[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(t).count(); }
+
+  Long64_t             GetNEvents    (void) { return nEvents_;     }
+  Long64_t             GetNCandidates(void) { return nCandidates_; }
+
+ private:
+
+  virtual void         Report        (const bool final);
+  static std::string   StageName     (const UInt_t i) { return (i==kRead ? "read" : (i==kSelect ? "select" : "fill")); }
+
+  std::string                              label_;
+  Long64_t                                 nTotal_;
+  std::chrono::duration<double>            interval_;
+  std::chrono::steady_clock::time_point    start_;
+  Long64_t                                 bytesStart_;
+
+  std::atomic<Long64_t>                    nEvents_;
+  std::atomic<Long64_t>                    nCandidates_;
+  std::atomic<Long64_t>                    time_[kNStage];
+  std::atomic<Long64_t>                    nextReport_;
+
+  // Values at the previous report, to compute the current rates
+  double                                   lastTime_;
+  Long64_t                                 lastEvents_;
+  Long64_t                                 lastCandidates_;
+  Long64_t                                 lastBytes_;
+
+  std::mutex                               mutex_;
+  std::ofstream                            log_;
+};
+
+ProgressMonitor::ProgressMonitor(const double interval, const std::string& logFile) :
+  nTotal_(0), interval_(interval), bytesStart_(0), nEvents_(0), nCandidates_(0), nextReport_(0),
+  lastTime_(0.), lastEvents_(0), lastCandidates_(0), lastBytes_(0)
+{
+  for (auto& t : time_) { t = 0; }
+  if (logFile!="") {
+    log_.open(logFile.c_str(), std::ios::app);
+    if (!log_.is_open()) std::cout << "[ERROR] Failed to open the progress log " << logFile << std::endl;
+  }
+}
+
+void ProgressMonitor::Start(const std::string& label, const Long64_t nTotal)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  label_  = label;
+  nTotal_ = nTotal;
+  start_  = std::chrono::steady_clock::now();
+  bytesStart_ = TFile::GetFileBytesRead();
+  nEvents_ = 0; nCandidates_ = 0;
+  for (auto& t : time_) { t = 0; }
+  lastTime_ = 0.; lastEvents_ = 0; lastCandidates_ = 0; lastBytes_ = 0;
+  nextReport_ = std::chrono::duration_cast<std::chrono::nanoseconds>(interval_).count();
+}
+
+void ProgressMonitor::Update(void)
+{
+  // Cheap check first, then only one thread wins the report
+  const Long64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+  Long64_t next = nextReport_.load(std::memory_order_relaxed);
+  if (now < next) return;
+  if (!nextReport_.compare_exchange_strong(next, now + std::chrono::duration_cast<std::chrono::nanoseconds>(interval_).count())) return;
+  Report(false);
+}
+
+void ProgressMonitor::Finish(void)
+{
+  Report(true);
+}
+
+void ProgressMonitor::Report(const bool final)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const double   elapsed    = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  const Long64_t events     = nEvents_;
+  const Long64_t candidates = nCandidates_;
+  const Long64_t bytes      = TFile::GetFileBytesRead() - bytesStart_;
+  // Current rates since the previous report, average rates for the final one
+  const double   dt         = (final ? elapsed : elapsed - lastTime_);
+  const double   evtRate    = (dt>0. ? (final ? events     : events     - lastEvents_    )/dt : 0.);
+  const double   candRate   = (dt>0. ? (final ? candidates : candidates - lastCandidates_)/dt : 0.);
+  const double   mbRate     = (dt>0. ? (final ? bytes      : bytes      - lastBytes_     )/dt/1.E6 : 0.);
+  const double   avgRate    = (elapsed>0. ? events/elapsed : 0.);
+  const double   eta        = (avgRate>0. && nTotal_>events ? (nTotal_ - events)/avgRate : 0.);
+  lastTime_ = elapsed; lastEvents_ = events; lastCandidates_ = candidates; lastBytes_ = bytes;
+  ProcInfo_t procInfo;
+  gSystem->GetProcInfo(&procInfo);
+  const double rssMB = procInfo.fMemResident/1024.;
+  double stage[kNStage];
+  for (UInt_t i = 0; i < kNStage; i++) { stage[i] = time_[i]*1.E-9; }
+
+  const std::streamsize precision = std::cout.precision();
+  std::cout << std::fixed << std::setprecision(1)
+            << "[INFO] " << label_ << " : " << events << "/" << nTotal_ << " (" << (nTotal_>0 ? 100.*events/nTotal_ : 0.) << "%)"
+            << " " << evtRate << " evt/s, " << candRate << " cand/s, " << mbRate << " MB/s, "
+            << (final ? "done in " : "ETA ") << (final ? elapsed : eta) << " s, RSS " << rssMB << " MB, stages [s]:";
+  for (UInt_t i = 0; i < kNStage; i++) { std::cout << " " << StageName(i) << "=" << stage[i]; }
+  std::cout.unsetf(std::ios::fixed);
+  std::cout << std::setprecision(precision) << std::endl;
+
+  if (log_.is_open()) {
+    log_ << "{\"label\":\"" << label_ << "\",\"time\":" << std::time(0) << ",\"final\":" << (final ? "true" : "false")
+         << ",\"events\":" << events << ",\"total\":" << nTotal_ << ",\"candidates\":" << candidates << ",\"bytes\":" << bytes
+         << ",\"elapsed\":" << elapsed << ",\"evtRate\":" << evtRate << ",\"candRate\":" << candRate << ",\"mbRate\":" << mbRate
+         << ",\"eta\":" << eta << ",\"rssMB\":" << rssMB;
+    for (UInt_t i = 0; i < kNStage; i++) { log_ << ",\"" << StageName(i) << "\":" << stage[i]; }
+    log_ << "}" << std::endl;
+  }
+}
+
+#endif
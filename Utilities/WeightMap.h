@@ -0,0 +1,210 @@
+#ifndef WeightMap_h
+#define WeightMap_h
+
+// Header file for ROOT classes
+#include <TFile.h>
+#include <TH1.h>
+#include <TAxis.h>
+
+// Header file for c++ classes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+// Allocator returning cache-line aligned buffers
+template <typename T, size_t Align = 64>
+struct AlignedAllocator {
+  typedef T value_type;
+  template <typename U> struct rebind { typedef AlignedAllocator<U, Align> other; };
+  AlignedAllocator() {}
+  template <typename U> AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+  T* allocate(const size_t n) {
+    void* p = 0;
+    if (posix_memalign(&p, Align, std::max(n*sizeof(T), Align))!=0) throw std::bad_alloc();
+    return static_cast<T*>(p);
+  }
+  void deallocate(T* p, size_t) { std::free(p); }
+  template <typename U> bool operator==(const AlignedAllocator<U, Align>&) const { return true;  }
+  template <typename U> bool operator!=(const AlignedAllocator<U, Align>&) const { return false; }
+};
+
+typedef std::vector< double , AlignedAllocator<double> > AlignedVector;
+
+
+// Binning of one axis of a weight map, values outside the axis use the first or last bin
+typedef struct WeightAxis {
+  int            n;
+  double         min;
+  double         max;
+  double         invWidth;
+  bool           uniform;
+  AlignedVector  edge;     // lower edges, padded with +inf to a power of two
+  AlignedVector  center;
+
+  // O(1) for uniform bins, fixed-length binary search compiled to conditional moves otherwise.
+  // The comparisons are written so that a NaN goes to the first bin.
+  inline int Find(const double v) const {
+    if (uniform) {
+      double f = (v - min)*invWidth;
+      f = (f >= 0. ? f : 0.);
+      f = (f <= n - 1 ? f : n - 1);
+      return int(f);
+    }
+    const double* e = edge.data();
+    int base = 0;
+    for (int half = int(edge.size())/2; half > 0; half /= 2) { base = (e[base + half] <= v ? base + half : base); }
+    return std::min(base, n - 1);
+  }
+} WeightAxis;
+
+
+// Efficiency or scale factor map in (x, y), e.g. muon (pT, eta), loaded from a TH2 (or a TH1
+// in x only) into a flat aligned table. Efficiency maps can be inverted at load time so that
+// the lookup directly returns the weight 1/efficiency.
+class WeightMap2D {
+
+ public :
+
+  WeightMap2D();
+  virtual ~WeightMap2D() {};
+
+  virtual Bool_t       Load           (const std::string&, const bool inverse=false);
+  virtual Bool_t       Load           (const TH1*, const bool inverse=false);
+  void                 SetInterpolate (const bool interpolate) { interpolate_ = interpolate; }
+  // Look up the map with |y|, for maps binned in |eta|
+  void                 SetAbsY        (const bool absY) { absY_ = absY; }
+  bool                 IsLoaded       (void) const { return (value_.size()>0); }
+
+  // Weight of one object, and of all the objects of an event
+  inline double        Eval           (const double x, double y) const;
+  void                 Eval           (const double* x, const double* y, double* w, const size_t n) const;
+
+ private:
+
+  static void          SetAxis        (WeightAxis&, const TAxis*, const int n);
+  inline double        Value          (const int ix, const int iy) const { return value_[ix*ny_ + iy]; }
+  inline double        Interpolate    (const double x, const double y) const;
+
+  WeightAxis           xAxis_;
+  WeightAxis           yAxis_;
+  int                  ny_;
+  bool                 absY_;
+  bool                 interpolate_;
+  AlignedVector        value_;    // value_[ix*ny + iy]
+};
+
+WeightMap2D::WeightMap2D() : ny_(1), absY_(false), interpolate_(false)
+{
+}
+
+Bool_t WeightMap2D::Load(const std::string& spec, const bool inverse)
+{
+  // Specified as file.root:histName
+  const size_t pos = spec.rfind(':');
+  if (pos==std::string::npos) { std::cout << "[ERROR] Weight map " << spec << " must be given as file.root:histName" << std::endl; return false; }
+  std::unique_ptr<TFile> file(TFile::Open(spec.substr(0, pos).c_str(), "READ"));
+  if (!file || !file->IsOpen()) { std::cout << "[ERROR] Failed to open the weight map file " << spec.substr(0, pos) << std::endl; return false; }
+  TH1* h = 0;
+  file->GetObject(spec.substr(pos+1).c_str(), h);
+  if (!h) { std::cout << "[ERROR] Weight map " << spec << " not found!" << std::endl; return false; }
+  const Bool_t ok = Load(h, inverse);
+  delete h;
+  return ok;
+}
+
+Bool_t WeightMap2D::Load(const TH1* h, const bool inverse)
+{
+  if (!h || h->GetDimension() > 2) { std::cout << "[ERROR] Weight maps must be TH1 or TH2!" << std::endl; return false; }
+  const int nx = h->GetNbinsX(), ny = (h->GetDimension()==2 ? h->GetNbinsY() : 1);
+  SetAxis(xAxis_, h->GetXaxis(), nx);
+  SetAxis(yAxis_, (h->GetDimension()==2 ? h->GetYaxis() : 0), ny);
+  ny_ = ny;
+  if (h->GetDimension()==2 && yAxis_.min >= 0. && !absY_) {
+    std::cout << "[INFO] Weight map " << h->GetName() << " starts at y = " << yAxis_.min << ", negative y use its first bin (see SetAbsY)" << std::endl;
+  }
+  value_.assign(size_t(nx)*ny, 0.);
+  size_t nBad = 0;
+  for (int ix = 0; ix < nx; ix++) {
+    for (int iy = 0; iy < ny; iy++) {
+      double v = (h->GetDimension()==2 ? h->GetBinContent(h->GetBin(ix+1, iy+1)) : h->GetBinContent(ix+1));
+      if (inverse) { if (v > 0.) { v = 1./v; } else { v = 0.; nBad++; } }
+      value_[ix*ny + iy] = v;
+    }
+  }
+  if (nBad > 0) std::cout << "[INFO] Weight map " << h->GetName() << " has " << nBad << " empty bins, their weight is set to 0" << std::endl;
+  return true;
+}
+
+void WeightMap2D::SetAxis(WeightAxis& axis, const TAxis* a, const int n)
+{
+  axis.n = n;
+  axis.uniform = (!a || !a->IsVariableBinSize());
+  axis.min = (a ? a->GetXmin() : 0.);
+  axis.max = (a ? a->GetXmax() : 1.);
+  axis.invWidth = (a ? n/(axis.max - axis.min) : 0.);
+  size_t size = 1;
+  while (size < size_t(n) + 1) { size *= 2; }
+  axis.edge.assign(size, std::numeric_limits<double>::infinity());
+  axis.center.assign(n, 0.5);
+  for (int i = 0; i < n; i++) {
+    axis.edge[i]   = (a ? a->GetBinLowEdge(i+1) : -std::numeric_limits<double>::infinity());
+    axis.center[i] = (a ? a->GetBinCenter(i+1)  : 0.5);
+  }
+  // The first bin also collects the underflow
+  axis.edge[0] = -std::numeric_limits<double>::infinity();
+}
+
+inline double WeightMap2D::Eval(const double x, double y) const
+{
+  if (absY_) y = std::abs(y);
+  if (interpolate_) return Interpolate(x, y);
+  return Value(xAxis_.Find(x), yAxis_.Find(y));
+}
+
+void WeightMap2D::Eval(const double* x, const double* y, double* w, const size_t n) const
+{
+  if (!interpolate_ && xAxis_.uniform && yAxis_.uniform) {
+    // Straight-line loop over the objects of the event, vectorized by the compiler
+    const double xMin = xAxis_.min, xInv = xAxis_.invWidth, xLast = xAxis_.n - 1;
+    const double yMin = yAxis_.min, yInv = yAxis_.invWidth, yLast = yAxis_.n - 1;
+    const double* v = value_.data();
+    const int ny = ny_;
+    const bool absY = absY_;
+    for (size_t i = 0; i < n; i++) {
+      double fx = (x[i] - xMin)*xInv;
+      double fy = ((absY ? std::abs(y[i]) : y[i]) - yMin)*yInv;
+      // A NaN fails both comparisons and is clamped to the first bin, never converted to int
+      fx = (fx >= 0. ? (fx <= xLast ? fx : xLast) : 0.);
+      fy = (fy >= 0. ? (fy <= yLast ? fy : yLast) : 0.);
+      w[i] = v[int(fx)*ny + int(fy)];
+    }
+    return;
+  }
+  for (size_t i = 0; i < n; i++) { w[i] = Eval(x[i], y[i]); }
+}
+
+inline double WeightMap2D::Interpolate(const double x, const double y) const
+{
+  // Bilinear interpolation between the bin centers, constant beyond the first and last centers
+  auto locate = [](const WeightAxis& axis, const double v, int& i0, int& i1, double& t) {
+    const int i = axis.Find(v);
+    i0 = (v < axis.center[i] ? std::max(i-1, 0) : i);
+    i1 = std::min(i0+1, axis.n-1);
+    t  = (i1==i0 ? 0. : (v - axis.center[i0])/(axis.center[i1] - axis.center[i0]));
+    t  = (t >= 0. ? (t <= 1. ? t : 1.) : 0.);
+  };
+  int ix0, ix1, iy0, iy1;
+  double tx, ty;
+  locate(xAxis_, x, ix0, ix1, tx);
+  locate(yAxis_, y, iy0, iy1, ty);
+  return ((1.-tx)*(1.-ty)*Value(ix0, iy0) + tx*(1.-ty)*Value(ix1, iy0) +
+          (1.-tx)*ty*Value(ix0, iy1) + tx*ty*Value(ix1, iy1));
+}
+
+#endif